@@ -0,0 +1,43 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+class Cache {
+    enum {
+        VERSION = 3
+    };
+    struct Header {
+        char magic[8];
+        unsigned version;
+        unsigned opcodes;
+        unsigned long long fileSize;
+        long long fileTime;
+        unsigned long long hash;
+        unsigned long long checksum;
+        unsigned variant;
+        unsigned instructions;
+        unsigned rows;
+        unsigned symbols;
+        unsigned symbolBytes;
+        int stackSize;
+        int lineCount;
+    };
+
+    string path;
+    int variant;
+    unsigned long long fileSize;
+    long long fileTime;
+    bool hashed;
+    unsigned long long hash;
+    int lineCount;
+
+    bool decode(const char *data, size_t size, Program & program) const;
+    bool verify(const Program & program, int sourceLines) const;
+public:
+    Cache(const string & path, int variant);
+    void setFile(const string & source);
+    void setSource(const vector<string_view> & source);
+    bool load(Program & program) const;
+    bool save(const Program & program) const;
+};
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef CFG_H
+#define CFG_H
+
+struct BasicBlock {
+    int first;
+    int last;
+    vector<int> successors;
+    vector<int> predecessors;
+};
+
+class ControlFlowGraph {
+    const Program & program;
+    vector<BasicBlock> blocks;
+    vector<int> blockOf;
+
+    const Instruction & getTerminator(int row) const;
+    vector<int> getTargets(int row) const;
+    void printInstruction(ostream & out, int pc) const;
+public:
+    enum {
+        EXIT = -1
+    };
+    ControlFlowGraph(const Program & program);
+    const vector<BasicBlock> & getBlocks() const;
+    int getBlock(int row) const;
+    void print(ostream & out) const;
+};
+
+#endif
@@ -4,31 +4,43 @@
 #include <stack>
 
 using std::stack;
+using std::ostream;
 
 class Parser {
-    vector<string> code;
+    vector<string_view> code;
+    int first;
     int row;
-    int position;
+    vector<Token> tokens;
+    int token;
     enum STATE {
         OKAY,
         ERROR
     };
+    struct Block {
+        OPERATOR type;
+        int row;
+    };
 
-    string getSubcodeline(int n);
-    void shift(int n);
-    void skipSpaces();
+    string_view getName(const Token & current) const;
+    void readRow();
+    bool getOperator(OPERATOR type);
 
+    Arena arena;
     stack<Oper *> opers;
     vector<Lexem *> newPolizline;
+    vector<Block> blocks;
+    vector<string> newLabels;
 
-    bool getSequenceOfCommands();
     bool getCommand();
     bool getExpression();
     bool isEndOfLine();
-    bool isReservedWord(string word);
+
+    map<string, int, std::less<>> slots;
+    int getSlot(string_view name);
 
     bool getNumber();
     bool getVariable();
+    bool getCall();
 
     bool getAssignOperator();
     bool getBinaryOperator();
@@ -36,12 +48,16 @@ class Parser {
     bool getRightBracket();
     bool getLeftQBracket();
     bool getRightQBracket();
+    bool getComma();
+    bool getEndOfCall();
 
     bool getLabel();
     bool initLabel(string name);
     bool getGoto();
-    bool getIfBlock();
-    bool getWhileBlock();
+    bool openBlock(OPERATOR type);
+    bool getElseBlock();
+    bool closeIfBlock();
+    bool closeWhileBlock();
     bool getIf();
     bool getElse();
     bool getThen();
@@ -56,28 +72,17 @@ class Parser {
     void emptyOpersStack(STATE state = OKAY);
 public:
     vector<vector<Lexem *>> poliz;
-    bool buildPoliz(vector<string> code);
+    vector<string> symbols;
+    map<string, int> labels;
+    Parser();
+    bool buildPoliz(const vector<string_view> & code,
+                    ostream & err = std::cerr);
+    bool addLine(string_view line, ostream & err = std::cerr);
+    bool isComplete() const;
+    void discard();
     void freePoliz(STATE state = OKAY);
 };
 
-int getRightArgument(Lexem *operand);
-
-Lexem *performAssignment(Lexem *leftArg, int rightArg, Assign *assign);
-
-Lexem *performDereference(Lexem *leftArg, int rightArg, Dereference *deref);
-
-Lexem *performCalculation(Lexem *leftArg, int rightArg, Binary *binary);
-
-Lexem *currentResult(stack<Lexem *> & eval, Lexem *op);
-
-bool getCondition(Lexem *condition);
-
-int jump(Goto *op, stack<Lexem *> & eval, size_t row);
-
-int evaluatePoliz(vector<Lexem *> poliz, int row);
-
-void print(vector<Lexem *> v);
-
-void printMap();
+void print(vector<Lexem *> v, const vector<string> & symbols);
 
 #endif
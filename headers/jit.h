@@ -0,0 +1,49 @@
+#ifndef JIT_H
+#define JIT_H
+
+using std::pair;
+
+class Jit {
+    typedef void (*Entry)(Interpreter *interpreter, int *stack, int *variables,
+                          char *defined, char *dirty, const void *start);
+
+    const Program & program;
+    vector<unsigned char> code;
+    vector<int> rowStart;
+    vector<pair<int, int>> patches;
+    void *buffer;
+    size_t bufferSize;
+
+    void emitByte(int byte);
+    void emitInt(int value);
+    void emitRex(bool wide, int reg, int base);
+    void emitMemory(int reg, int base, int disp);
+    void emitLoad(int reg, int base, int disp);
+    void emitStore(int base, int disp, int reg);
+    void emitSetFlag(int base, int disp);
+    void emitMoveImmediate(int reg, int value);
+    void emitMove64(int dst, int src);
+    void emitCall(const void *function);
+    void emitJump(int condition, int row);
+    void emitCompare(int condition);
+    void emitDivisorCheck(int row);
+    void emitPrint(int depth);
+    bool compileBinary(OPCODE opcode);
+    bool compileRow(int row);
+
+    static int loadElement(Interpreter *interpreter, int slot, int index);
+    static void storeElement(Interpreter *interpreter, int slot, int index,
+                             int value);
+    static int callBuiltin(Interpreter *interpreter, int builtin,
+                           const int *args);
+    static void print(Interpreter *interpreter, int value);
+    static void undefinedLabel(Interpreter *interpreter, int slot);
+    static void divisionByZero(Interpreter *interpreter, int row);
+public:
+    Jit(const Program & program);
+    ~Jit();
+    bool compile();
+    void run(Interpreter & interpreter);
+};
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+int combine(OPERATOR type, int left, int right);
+void fillArray(int *data, int n, int value);
+void combineArrays(OPERATOR type, int *data, const int *other, int n);
+void combineValue(OPERATOR type, int *data, int value, int n);
+int sumArray(const int *data, int n);
+int minArray(const int *data, int n);
+int maxArray(const int *data, int n);
+int countEqual(const int *data, int n, int value);
+
+#endif
@@ -21,6 +21,7 @@ enum OPERATOR {
     GOTO, ASSIGN, COLON,
     LBRACKET, RBRACKET,
     LQBRACKET, RQBRACKET, DEREF,
+    COMMA, CALL,
     OR,
     AND,
     BITOR,
@@ -36,13 +37,14 @@ enum OPERATOR {
     MULT, DIV, MOD
 };
 
-string OPERATOR_STRING[] = {
+constexpr const char *OPERATOR_STRING[] = {
     "if", "then",
     "else", "endif",
     "while", "endwhile",
     "goto", ":=", ":",
     "(", ")",
     "[", "]", "dereference",
+    ",", "call",
     "||",
     "&&",
     "|",
@@ -58,13 +60,14 @@ string OPERATOR_STRING[] = {
     "*", "/", "%"
 };
 
-int PRIORITY[] = {
+constexpr int PRIORITY[] = {
     -1, -1,
     -1, -1,
     -1, -1,
     -1, 0, -1,
     -1, -1,
     -1, -1, -1,
+    -1, -1,
     1,
     2,
     3,
@@ -80,15 +83,60 @@ int PRIORITY[] = {
     10, 10, 10
 };
 
-string RESERVED[] = {
-    "if", "else", "while",
-    "then", "endif", "endwhile"
+
+enum BUILTIN {
+    BUILTIN_FILL, BUILTIN_COPY,
+    BUILTIN_ADD, BUILTIN_SUB, BUILTIN_MUL,
+    BUILTIN_AND, BUILTIN_OR, BUILTIN_XOR,
+    BUILTIN_ADDS, BUILTIN_SUBS, BUILTIN_MULS,
+    BUILTIN_ANDS, BUILTIN_ORS, BUILTIN_XORS,
+    BUILTIN_SUM, BUILTIN_MIN, BUILTIN_MAX, BUILTIN_COUNT
+};
+
+constexpr const char *BUILTIN_STRING[] = {
+    "fill", "copy",
+    "add", "sub", "mul",
+    "and", "or", "xor",
+    "adds", "subs", "muls",
+    "ands", "ors", "xors",
+    "sum", "min", "max", "count"
+};
+
+/* 'a' is an array name, 'v' any expression. The last two arguments are
+ * always the index range [from, to). */
+constexpr const char *BUILTIN_PARAMETERS[] = {
+    "avvv", "aavv",
+    "aavv", "aavv", "aavv",
+    "aavv", "aavv", "aavv",
+    "avvv", "avvv", "avvv",
+    "avvv", "avvv", "avvv",
+    "avv", "avv", "avv", "avvv"
+};
+
+int getArity(BUILTIN builtin);
+
+
+class Arena {
+    enum {
+        CHUNK_SIZE = 64 * 1024
+    };
+    vector<char *> chunks;
+    int current;
+    size_t used;
+public:
+    Arena();
+    ~Arena();
+    void *allocate(size_t size);
+    void release();
 };
 
+void *operator new(size_t size, Arena & arena);
+void operator delete(void *pointer, Arena & arena);
+
 class Lexem {
 public:
     Lexem();
-    virtual ~Lexem();
+    virtual bool isOperator() const;
 };
 
 class Number : public Lexem {
@@ -99,29 +147,17 @@ public:
 };
 
 class Variable : public Lexem {
-    string name;
-public:
-    static map<string, int> VarTable;
-    Variable(string name);
-    string getName() const;
-    int getValue() const;
-    void setValue(int value) const;
-};
-
-class ArrayElem : public Lexem {
-    string name;
-    int index;
+    int slot;
 public:
-    static map<string, vector<int>> ArrayTable;
-    ArrayElem(string name, int index);
-    int getValue() const;
-    void setValue(int value) const;
+    Variable(int slot);
+    int getSlot() const;
 };
 
 class Oper : public Lexem {
     OPERATOR opertype;
 public:
     Oper(OPERATOR opertype);
+    bool isOperator() const;
     OPERATOR getType() const;
     int getPriority() const;
 };
@@ -135,24 +171,29 @@ public:
 class Assign : public Oper {
 public:
     Assign();
-    int getValue(const Variable & left, int right) const;
-    int getValue(const ArrayElem & left, int right) const;
 };
 
 class Goto : public Oper {
     int row;
 public:
-    static map<string, int> LabelTable;
     Goto(OPERATOR opertype);
     void setRow(int row);
     int getRow();
-    int getValue(const Variable & var) const;
 };
 
 class Dereference : public Oper {
 public:
     Dereference();
-    ArrayElem *getValue(string name, int index) const;
+};
+
+class Call : public Oper {
+    BUILTIN builtin;
+    int arguments;
+public:
+    Call(BUILTIN builtin);
+    BUILTIN getBuiltin() const;
+    void addArgument();
+    bool isComplete() const;
 };
 
 #endif
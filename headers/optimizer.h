@@ -0,0 +1,26 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+class Optimizer {
+    Program & program;
+    vector<vector<Instruction>> rows;
+    vector<char> reachable;
+
+    void split();
+    void join(const vector<int> & newRow);
+    vector<int> getSuccessors(int row) const;
+    bool fold(vector<Instruction> & code);
+    bool reduce(vector<Instruction> & code);
+    void simplify(vector<Instruction> & row);
+    void findReachable();
+    void removeDeadStores();
+    bool fuseUpdate(vector<Instruction> & code);
+    bool fuseBranch(vector<Instruction> & code);
+    void fuse(vector<Instruction> & row);
+    vector<int> renumber(bool removeEmpty) const;
+public:
+    Optimizer(Program & program);
+    void optimize(bool observable);
+};
+
+#endif
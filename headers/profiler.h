@@ -0,0 +1,29 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+class Profiler {
+    struct Loop {
+        int first;
+        int last;
+        long long iterations;
+        unsigned long long cycles;
+    };
+
+    const Program & program;
+    const Interpreter & interpreter;
+    const vector<string_view> & source;
+    unsigned long long total;
+
+    bool isConditional(int row) const;
+    vector<Loop> getLoops() const;
+    vector<long long> getOperatorCounts() const;
+    void writeJson(ostream & out) const;
+    void writeCsv(ostream & out) const;
+public:
+    Profiler(const Program & program, const Interpreter & interpreter,
+             const vector<string_view> & source);
+    void printReport(ostream & out) const;
+    bool write(const string & path) const;
+};
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <unordered_map>
+
+using std::ostream;
+using std::unordered_map;
+
+enum OPCODE {
+    OP_PUSH_NUM,
+    OP_LOAD, OP_LOAD_UNDER,
+    OP_LOAD_ELEM, OP_LOAD_ELEM_UNDER,
+    OP_OR,
+    OP_AND,
+    OP_BITOR,
+    OP_XOR,
+    OP_BITAND,
+    OP_EQ,
+    OP_NEQ,
+    OP_LEQ, OP_SHL,
+    OP_LT,
+    OP_GEQ, OP_SHR,
+    OP_GT,
+    OP_PLUS, OP_MINUS,
+    OP_MULT, OP_DIV, OP_MOD,
+    OP_MULT_POW2, OP_DIV_POW2, OP_MOD_POW2,
+    OP_STORE, OP_STORE_ELEM, OP_CALL,
+    OP_INC, OP_UPDATE_MULT, OP_LOAD_MOD,
+    OP_PRINT,
+    OP_END, OP_JUMP, OP_JUMP_FALSE, OP_GOTO,
+    OP_BRANCH_EQ,
+    OP_BRANCH_NEQ,
+    OP_BRANCH_LEQ,
+    OP_BRANCH_LT,
+    OP_BRANCH_GEQ,
+    OP_BRANCH_GT,
+    OP_HALT
+};
+
+extern const char *OPCODE_STRING[];
+
+struct Instruction {
+    OPCODE opcode;
+    int operand;
+    int argument;
+};
+
+struct Operand {
+    enum KIND {
+        VALUE,
+        VARIABLE,
+        ELEMENT
+    } kind;
+    int slot;
+    int offset;
+    int assigns;
+};
+
+class Program {
+    friend class Interpreter;
+    friend class Optimizer;
+    friend class Jit;
+    friend class Profiler;
+    friend class Cache;
+    friend class ControlFlowGraph;
+    friend class RegisterVm;
+    friend class Ssa;
+    friend class Trace;
+
+    vector<Instruction> code;
+    vector<int> rowOffset;
+    vector<int> lines;
+    vector<string> symbols;
+    vector<int> labels;
+    int stackSize;
+
+    int emit(OPCODE opcode, int operand = 0, int argument = 0);
+    bool compileRow(const vector<Lexem *> & polizline);
+public:
+    Program();
+    bool compile(const vector<vector<Lexem *>> & poliz,
+                 const vector<string> & symbols,
+                 const map<string, int> & labels,
+                 ostream & err = std::cerr);
+    bool append(const vector<vector<Lexem *>> & poliz,
+                const vector<string> & symbols,
+                const map<string, int> & labels,
+                ostream & err = std::cerr);
+    int size() const;
+};
+
+class Array {
+    enum {
+        PAGE_BITS = 10,
+        PAGE_SIZE = 1 << PAGE_BITS,
+        DENSE_LIMIT = 1 << 16
+    };
+    vector<int> values;
+    unordered_map<int, vector<int>> pages;
+    bool used;
+    bool paged;
+
+    bool isDense(int index);
+    void grow(int index);
+public:
+    Array();
+    bool isUsed() const;
+    int *getRange(int from, int to);
+    int load(int index);
+    void store(int index, int value);
+    void print(ostream & out) const;
+    void printMemory(ostream & out) const;
+};
+
+enum DUMP {
+    DUMP_NONE,
+    DUMP_FINAL,
+    DUMP_EVERY,
+    DUMP_CHANGED
+};
+
+class Trace;
+
+class Interpreter {
+    friend class Jit;
+    friend class Profiler;
+    friend class RegisterVm;
+
+    const Program & program;
+    ostream & out;
+    ostream & err;
+    int row;
+    vector<long long> rowCounts;
+    vector<unsigned long long> rowCycles;
+    vector<long long> rowTaken;
+    vector<const void *> threaded;
+    vector<int> stack;
+    vector<int> variables;
+    vector<char> defined;
+    vector<char> dirty;
+    vector<Array> arrays;
+    vector<char> arrayDirty;
+    Trace *trace;
+    bool failed;
+
+    int call(int builtin, const int *args);
+    void runCounted(int steps);
+public:
+    Interpreter(const Program & program, ostream & out = std::cout,
+                ostream & err = std::cerr);
+    bool isFinished() const;
+    bool hasFailed() const;
+    void run(int steps);
+    void execute(DUMP mode, int steps);
+    void countRows();
+    void setTrace(Trace *trace);
+    long long getExecutedRows() const;
+    void printMap() const;
+    void printChanged();
+    void printStatistics() const;
+    void printMemory() const;
+};
+
+bool getDumpMode(string arg, DUMP & mode, int & steps);
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef REGVM_H
+#define REGVM_H
+
+enum REGISTER_OPCODE {
+    R_OR,
+    R_AND,
+    R_BITOR,
+    R_XOR,
+    R_BITAND,
+    R_EQ,
+    R_NEQ,
+    R_LEQ, R_SHL,
+    R_LT,
+    R_GEQ, R_SHR,
+    R_GT,
+    R_PLUS, R_MINUS,
+    R_MULT, R_DIV, R_MOD,
+    R_MULT_POW2, R_DIV_POW2, R_MOD_POW2,
+    R_MOVE, R_LOAD_ELEM,
+    R_STORE, R_STORE_ELEM, R_CALL,
+    R_INC, R_UPDATE_MULT,
+    R_PRINT,
+    R_END, R_JUMP, R_JUMP_FALSE, R_GOTO,
+    R_BRANCH_EQ,
+    R_BRANCH_NEQ,
+    R_BRANCH_LEQ,
+    R_BRANCH_LT,
+    R_BRANCH_GEQ,
+    R_BRANCH_GT,
+    R_HALT
+};
+
+struct RegisterInstruction {
+    REGISTER_OPCODE opcode;
+    int argument;
+    int *target;
+    const int *left;
+    const int *right;
+};
+
+class RegisterVm {
+    struct Location {
+        enum KIND {
+            NONE,
+            REGISTER,
+            VARIABLE,
+            CONSTANT
+        } kind;
+        int index;
+    };
+    struct Code {
+        REGISTER_OPCODE opcode;
+        int argument;
+        Location target;
+        Location left;
+        Location right;
+    };
+
+    const Program & program;
+    vector<Code> code;
+    vector<int> rowOffset;
+    vector<int> reads;
+    vector<int> readOffset;
+    vector<RegisterInstruction> linked;
+    vector<const void *> threaded;
+    vector<int> registers;
+    vector<int> constants;
+    vector<char> visited;
+    int scratch;
+
+    void emit(REGISTER_OPCODE opcode, int argument = 0,
+              Location target = {Location::NONE, 0},
+              Location left = {Location::NONE, 0},
+              Location right = {Location::NONE, 0});
+    void release(vector<Location> & stack, int slot);
+    bool compileRow(int row);
+    int *locate(Interpreter & interpreter, Location location);
+    void link(Interpreter & interpreter);
+    void enter(Interpreter & interpreter, int row);
+    void run(Interpreter & interpreter, int steps);
+public:
+    RegisterVm(const Program & program);
+    bool compile();
+    int size() const;
+    void execute(Interpreter & interpreter, DUMP mode, int steps);
+};
+
+#endif
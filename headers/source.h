@@ -0,0 +1,21 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+class Source {
+    char *mapping;
+    size_t mappingSize;
+    string buffer;
+    vector<string_view> lines;
+
+    bool mapFile(int fd);
+    bool load(int fd);
+    void split(string_view text);
+public:
+    Source();
+    ~Source();
+    bool open(const string & path);
+    bool readStdin();
+    const vector<string_view> & getLines() const;
+};
+
+#endif
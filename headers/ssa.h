@@ -0,0 +1,101 @@
+#ifndef SSA_H
+#define SSA_H
+
+using std::pair;
+
+class Ssa {
+    struct Value {
+        enum KIND {
+            CONSTANT,
+            ENTRY,
+            PHI,
+            OPERATION,
+            OPAQUE
+        } kind;
+        int operand;
+        int left;
+        int right;
+    };
+    struct Cell {
+        int value;
+        int begin;
+        int end;
+        bool pure;
+        bool unsafe;
+    };
+    struct Candidate {
+        int row;
+        int begin;
+        int end;
+        int value;
+        int holder;
+        int induction;
+        bool unsafe;
+    };
+    struct Store {
+        int row;
+        int slot;
+        int value;
+        int previous;
+    };
+    struct Loop {
+        int header;
+        int first;
+        int last;
+    };
+    struct Change {
+        int slot;
+        int version;
+    };
+
+    Program & program;
+    ControlFlowGraph cfg;
+    vector<Value> values;
+    unordered_map<long long, int> operations;
+    unordered_map<int, int> constants;
+    vector<int> order;
+    vector<int> idom;
+    vector<vector<int>> phis;
+    vector<vector<pair<int, int>>> phiInputs;
+    vector<char> phiStored;
+    vector<int> current;
+    unordered_map<int, vector<int>> holders;
+    vector<Change> changes;
+    vector<int> loadVersion;
+    vector<Candidate> candidates;
+    vector<Store> stores;
+    vector<Loop> loops;
+    vector<int> innermost;
+    vector<int> parent;
+    vector<vector<int>> storeRows;
+
+    int getConstant(int value);
+    int getOperation(OPCODE opcode, int left, int right);
+    int getOpaque();
+    void setVersion(int slot, int value);
+    void undo(int mark);
+    int getHolder(int value) const;
+    bool isSupported() const;
+    bool isStored(int version) const;
+    int getInduction(int begin, int end, const vector<int> & stored) const;
+    void findDominators();
+    void findLoops();
+    void nestLoops();
+    void placePhis();
+    void renameRow(int row);
+    void rename();
+    void markStored();
+    vector<int> getLoops(int row) const;
+    bool isHoistable(const Candidate & candidate, int loop) const;
+    bool isInduction(int loop, int slot) const;
+    bool getStep(const Store & store, int & step) const;
+    int addTemporary();
+    void insertPreheader(vector<vector<Instruction>> & rows, int loop,
+                         const vector<Instruction> & code);
+    void rewrite();
+public:
+    Ssa(Program & program);
+    void optimize();
+};
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <string_view>
+
+using std::string_view;
+
+enum TOKEN {
+    TOKEN_NUMBER,
+    TOKEN_IDENTIFIER,
+    TOKEN_OPERATOR,
+    TOKEN_ERROR
+};
+
+struct Token {
+    TOKEN kind;
+    int value;
+    int position;
+    int length;
+};
+
+void tokenize(string_view line, vector<Token> & tokens);
+
+#endif
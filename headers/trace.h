@@ -0,0 +1,58 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <string_view>
+
+using std::string_view;
+
+/* One instruction about to run: its index in the program's code and the
+ * two values on top of the stack, which are the operands it reads. */
+struct TraceEvent {
+    unsigned pc;
+    int left;
+    int right;
+};
+
+class Trace {
+    enum {
+        VERSION = 2
+    };
+    struct Header {
+        char magic[8];
+        unsigned version;
+        unsigned opcodes;
+        unsigned rows;
+        unsigned instructions;
+        unsigned events;
+        unsigned long long recorded;
+    };
+
+    const Program & program;
+    string path;
+    vector<TraceEvent> events;
+    unsigned mask;
+    unsigned long long count;
+
+    static void handleSignal(int signal);
+public:
+    enum {
+        DEFAULT_SIZE = 1 << 16,
+        MAX_SIZE = 1 << 24
+    };
+
+    Trace(const Program & program, const string & path, int size = DEFAULT_SIZE);
+    ~Trace();
+    void record(int pc, int left, int right) {
+        events[count & mask] = {(unsigned)pc, left, right};
+        std::atomic_signal_fence(std::memory_order_release);
+        count++;
+    }
+    void activate();
+    bool dump() const;
+    static void installHandlers();
+    static bool decode(const string & path, const vector<string_view> & source,
+                       ostream & out, ostream & err);
+};
+
+#endif
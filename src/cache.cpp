@@ -0,0 +1,325 @@
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "lexemes.h"
+#include "tokenizer.h"
+#include "program.h"
+#include "cache.h"
+
+static const char MAGIC[8] = {'P', 'O', 'L', 'I', 'Z', 'B', 'C', 0};
+
+static_assert(sizeof(Instruction) == 3 * sizeof(int),
+              "instructions are stored as they are laid out in memory");
+
+static unsigned long long getChecksum(const char *data, size_t size,
+                                      unsigned long long hash = 14695981039346656037ull) {
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/* No source file has this size, so a cache written for standard input
+ * can only be matched by the hash of its text. */
+static const unsigned long long NO_FILE = ~0ull;
+
+/* A cache file holds one compiled and optimized program. It is only used
+ * when the format version, the opcode numbering and the optimizer variant
+ * match, the payload checksum and structure are valid, and it was written
+ * for the same source: either a file that still has the same size and
+ * modification time, which costs one stat and no reading, or text with
+ * the same hash. Otherwise the caller compiles from source. */
+Cache::Cache(const string & path, int variant) : path(path) {
+    Cache::variant = variant;
+    fileSize = NO_FILE;
+    fileTime = 0;
+    hashed = false;
+    hash = 0;
+    lineCount = 0;
+}
+
+/* Takes the key of the script file before it is read, so that a change
+ * made while it is being compiled makes the next run fall back to the
+ * hash instead of trusting stale code. */
+void Cache::setFile(const string & source) {
+    struct stat info;
+    if (stat(source.c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+        fileSize = info.st_size;
+        fileTime = info.st_mtim.tv_sec * 1000000000ll + info.st_mtim.tv_nsec;
+    }
+}
+
+void Cache::setSource(const vector<string_view> & source) {
+    hash = getChecksum(nullptr, 0);
+    for (int i = 0; i < (int)source.size(); i++) {
+        hash = getChecksum(source[i].data(), source[i].size(), hash);
+        hash = getChecksum("\n", 1, hash);
+    }
+    hashed = true;
+    lineCount = (int)source.size();
+}
+
+static void append(string & data, const void *value, size_t size) {
+    data.append((const char *)value, size);
+}
+
+bool Cache::save(const Program & program) const {
+    string payload;
+    append(payload, program.code.data(), program.code.size() * sizeof(Instruction));
+    append(payload, program.rowOffset.data(), program.rowOffset.size() * sizeof(int));
+    append(payload, program.lines.data(), program.lines.size() * sizeof(int));
+    append(payload, program.labels.data(), program.labels.size() * sizeof(int));
+    size_t symbolStart = payload.size();
+    for (int i = 0; i < (int)program.symbols.size(); i++) {
+        unsigned length = (unsigned)program.symbols[i].size();
+        append(payload, &length, sizeof(length));
+        payload += program.symbols[i];
+    }
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.opcodes = OP_HALT + 1;
+    header.fileSize = fileSize;
+    header.fileTime = fileTime;
+    header.hash = hash;
+    header.checksum = getChecksum(payload.data(), payload.size());
+    header.variant = variant;
+    header.instructions = (unsigned)program.code.size();
+    header.rows = (unsigned)program.size();
+    header.symbols = (unsigned)program.symbols.size();
+    header.symbolBytes = (unsigned)(payload.size() - symbolStart);
+    header.stackSize = program.stackSize;
+    header.lineCount = lineCount;
+    string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        out.write((const char *)&header, sizeof(header));
+        out.write(payload.data(), payload.size());
+        if (out.good() == false) {
+            out.close();
+            remove(temporary.c_str());
+            return false;
+        }
+    }
+    return rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+bool Cache::load(Program & program) const {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    void *address = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(Header)) {
+        address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (address == MAP_FAILED) {
+        return false;
+    }
+    bool loaded = decode((const char *)address, info.st_size, program);
+    munmap(address, info.st_size);
+    return loaded;
+}
+
+template <typename T>
+static const char *take(const char *data, vector<T> & values, size_t count) {
+    values.resize(count);
+    memcpy(values.data(), data, count * sizeof(T));
+    return data + count * sizeof(T);
+}
+
+bool Cache::decode(const char *data, size_t size, Program & program) const {
+    Header header;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header.version != VERSION || header.opcodes != OP_HALT + 1 ||
+        (int)header.variant != variant || header.instructions == 0) {
+        return false;
+    }
+    bool sameFile = fileSize != NO_FILE && header.fileSize == fileSize &&
+                    header.fileTime == fileTime;
+    if (sameFile == false && (hashed == false || header.hash != hash)) {
+        return false;
+    }
+    unsigned long long expected = sizeof(Header) +
+        (unsigned long long)header.instructions * sizeof(Instruction) +
+        ((unsigned long long)header.rows * 2 + 1 + header.symbols) * sizeof(int) +
+        header.symbolBytes;
+    if (expected != size ||
+        getChecksum(data + sizeof(Header), size - sizeof(Header)) != header.checksum) {
+        return false;
+    }
+    Program loaded;
+    const char *end = data + size;
+    data = take(data + sizeof(Header), loaded.code, header.instructions);
+    data = take(data, loaded.rowOffset, (size_t)header.rows + 1);
+    data = take(data, loaded.lines, header.rows);
+    data = take(data, loaded.labels, header.symbols);
+    for (unsigned i = 0; i < header.symbols; i++) {
+        unsigned length;
+        if (end - data < (long)sizeof(length)) {
+            return false;
+        }
+        memcpy(&length, data, sizeof(length));
+        data += sizeof(length);
+        if ((unsigned long)(end - data) < length) {
+            return false;
+        }
+        loaded.symbols.push_back(string(data, length));
+        data += length;
+    }
+    loaded.stackSize = header.stackSize;
+    if (data != end || verify(loaded, header.lineCount) == false) {
+        return false;
+    }
+    program = loaded;
+    return true;
+}
+
+/* Checks everything the interpreter and the JIT take on trust: row
+ * offsets and terminators, jump targets, slots, built-in arities, fused
+ * divisors and the stack depth of every row. */
+bool Cache::verify(const Program & program, int sourceLines) const {
+    int rows = program.size();
+    int symbols = (int)program.symbols.size();
+    if (program.rowOffset[0] != 0 || program.stackSize < 0 ||
+        program.rowOffset[rows] != (int)program.code.size() - 1 ||
+        program.code.back().opcode != OP_HALT) {
+        return false;
+    }
+    for (int i = 0; i < symbols; i++) {
+        if (program.labels[i] < UNDEFINED || program.labels[i] > rows) {
+            return false;
+        }
+    }
+    for (int row = 0; row < rows; row++) {
+        if (program.rowOffset[row] >= program.rowOffset[row + 1] ||
+            program.lines[row] < 0 || program.lines[row] >= sourceLines) {
+            return false;
+        }
+        int depth = 0;
+        for (int pc = program.rowOffset[row]; pc < program.rowOffset[row + 1]; pc++) {
+            const Instruction & instruction = program.code[pc];
+            int operand = instruction.operand;
+            int needed = 0;
+            int pushed = 0;
+            bool slot = false;
+            bool terminator = instruction.opcode == OP_END ||
+                              instruction.opcode == OP_JUMP ||
+                              instruction.opcode == OP_JUMP_FALSE ||
+                              instruction.opcode == OP_GOTO ||
+                              (instruction.opcode >= OP_BRANCH_EQ &&
+                               instruction.opcode <= OP_BRANCH_GT);
+            if (terminator != (pc == program.rowOffset[row + 1] - 1)) {
+                return false;
+            }
+            switch (instruction.opcode) {
+                case OP_PUSH_NUM:
+                    pushed = 1;
+                    break;
+                case OP_LOAD_MOD:
+                    if (instruction.argument == 0) {
+                        return false;
+                    }
+                    slot = true;
+                    pushed = 1;
+                    break;
+                case OP_LOAD:
+                case OP_INC:
+                case OP_UPDATE_MULT:
+                    slot = true;
+                    pushed = 1;
+                    break;
+                case OP_LOAD_UNDER:
+                case OP_LOAD_ELEM_UNDER:
+                    slot = true;
+                    needed = 2;
+                    pushed = 2;
+                    break;
+                case OP_LOAD_ELEM:
+                case OP_STORE:
+                    slot = true;
+                    needed = 1;
+                    pushed = 1;
+                    break;
+                case OP_STORE_ELEM:
+                    slot = true;
+                    needed = 2;
+                    pushed = 1;
+                    break;
+                case OP_MULT_POW2:
+                case OP_DIV_POW2:
+                case OP_MOD_POW2:
+                    if (operand < 0 || operand > 31) {
+                        return false;
+                    }
+                    needed = 1;
+                    pushed = 1;
+                    break;
+                case OP_CALL:
+                    if (operand < BUILTIN_FILL || operand > BUILTIN_COUNT ||
+                        instruction.argument != getArity(BUILTIN(operand))) {
+                        return false;
+                    }
+                    needed = instruction.argument;
+                    pushed = 1;
+                    break;
+                case OP_PRINT:
+                    needed = 1;
+                    pushed = 1;
+                    break;
+                case OP_END:
+                    break;
+                case OP_JUMP:
+                case OP_JUMP_FALSE:
+                    if (operand < 0 || operand > rows) {
+                        return false;
+                    }
+                    needed = instruction.opcode == OP_JUMP_FALSE;
+                    pushed = needed;
+                    break;
+                case OP_GOTO:
+                    if (operand >= 0 && operand < symbols &&
+                        program.labels[operand] != UNDEFINED) {
+                        return false;
+                    }
+                    slot = true;
+                    break;
+                case OP_BRANCH_EQ:
+                case OP_BRANCH_NEQ:
+                case OP_BRANCH_LEQ:
+                case OP_BRANCH_LT:
+                case OP_BRANCH_GEQ:
+                case OP_BRANCH_GT:
+                    if (instruction.argument < 0 || instruction.argument > rows) {
+                        return false;
+                    }
+                    needed = 1;
+                    pushed = 1;
+                    break;
+                default:
+                    if (instruction.opcode < OP_OR || instruction.opcode > OP_MOD) {
+                        return false;
+                    }
+                    needed = 2;
+                    pushed = 1;
+                    break;
+            }
+            if ((slot && (operand < 0 || operand >= symbols)) || depth < needed) {
+                return false;
+            }
+            depth += pushed - needed;
+            if (depth > program.stackSize) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,159 @@
+#include <algorithm>
+#include "lexemes.h"
+#include "program.h"
+#include "cfg.h"
+
+static bool isBranch(OPCODE opcode) {
+    return opcode >= OP_BRANCH_EQ && opcode <= OP_BRANCH_GT;
+}
+
+/* Rows are the unit of control flow: only the last instruction of a row
+ * jumps, and every jump lands on the first instruction of a row. A block
+ * is a run of rows that is entered at its first row and left at its last. */
+ControlFlowGraph::ControlFlowGraph(const Program & program) :
+    program(program) {
+    int rows = program.size();
+    vector<char> leader(rows + 1, false);
+    leader[0] = true;
+    for (int row = 0; row < rows; row++) {
+        if (getTerminator(row).opcode == OP_END) {
+            continue;
+        }
+        leader[row + 1] = true;
+        vector<int> targets = getTargets(row);
+        for (int i = 0; i < (int)targets.size(); i++) {
+            leader[targets[i]] = true;
+        }
+    }
+    blockOf.resize(rows);
+    for (int row = 0; row < rows; row++) {
+        if (leader[row]) {
+            blocks.push_back({row, row, {}, {}});
+        }
+        blocks.back().last = row;
+        blockOf[row] = (int)blocks.size() - 1;
+    }
+    for (int block = 0; block < (int)blocks.size(); block++) {
+        vector<int> targets = getTargets(blocks[block].last);
+        vector<int> & successors = blocks[block].successors;
+        for (int i = 0; i < (int)targets.size(); i++) {
+            int successor = targets[i] == rows ? EXIT : blockOf[targets[i]];
+            if (std::find(successors.begin(), successors.end(),
+                          successor) != successors.end()) {
+                continue;
+            }
+            successors.push_back(successor);
+            if (successor != EXIT) {
+                blocks[successor].predecessors.push_back(block);
+            }
+        }
+    }
+}
+
+const Instruction & ControlFlowGraph::getTerminator(int row) const {
+    return program.code[program.rowOffset[row + 1] - 1];
+}
+
+/* Rows control can reach next from the end of a row; the row after the
+ * last one is the exit. A goto the REPL has not resolved yet halts. */
+vector<int> ControlFlowGraph::getTargets(int row) const {
+    const Instruction & last = getTerminator(row);
+    switch (last.opcode) {
+        case OP_END:
+            return {row + 1};
+        case OP_JUMP:
+            return {last.operand};
+        case OP_JUMP_FALSE:
+            return {row + 1, last.operand};
+        case OP_GOTO:
+            return {};
+        default:
+            return {row + 1, last.argument};
+    }
+}
+
+const vector<BasicBlock> & ControlFlowGraph::getBlocks() const {
+    return blocks;
+}
+
+int ControlFlowGraph::getBlock(int row) const {
+    return blockOf[row];
+}
+
+void ControlFlowGraph::printInstruction(ostream & out, int pc) const {
+    const Instruction & instruction = program.code[pc];
+    out << "    " << pc << '\t' << OPCODE_STRING[instruction.opcode];
+    switch (instruction.opcode) {
+        case OP_LOAD:
+        case OP_LOAD_UNDER:
+        case OP_LOAD_ELEM:
+        case OP_LOAD_ELEM_UNDER:
+        case OP_STORE:
+        case OP_STORE_ELEM:
+        case OP_GOTO:
+            out << ' ' << program.symbols[instruction.operand];
+            break;
+        case OP_INC:
+        case OP_UPDATE_MULT:
+        case OP_LOAD_MOD:
+            out << ' ' << program.symbols[instruction.operand] << ' ' <<
+                instruction.argument;
+            break;
+        case OP_PUSH_NUM:
+        case OP_MULT_POW2:
+        case OP_DIV_POW2:
+        case OP_MOD_POW2:
+            out << ' ' << instruction.operand;
+            break;
+        case OP_CALL:
+            out << ' ' << BUILTIN_STRING[instruction.operand];
+            break;
+        case OP_JUMP:
+        case OP_JUMP_FALSE:
+            if (instruction.operand == program.size()) {
+                out << " exit";
+            } else {
+                out << " B" << blockOf[instruction.operand];
+            }
+            break;
+        default:
+            if (isBranch(instruction.opcode)) {
+                out << ' ' << instruction.operand;
+                if (instruction.argument == program.size()) {
+                    out << " exit";
+                } else {
+                    out << " B" << blockOf[instruction.argument];
+                }
+            }
+            break;
+    }
+    out << '\n';
+}
+
+void ControlFlowGraph::print(ostream & out) const {
+    for (int block = 0; block < (int)blocks.size(); block++) {
+        const BasicBlock & current = blocks[block];
+        out << 'B' << block << "\tlines " << program.lines[current.first] + 1 <<
+            '-' << program.lines[current.last] + 1 << "\t<-";
+        if (block == 0) {
+            out << " entry";
+        }
+        for (int i = 0; i < (int)current.predecessors.size(); i++) {
+            out << " B" << current.predecessors[i];
+        }
+        out << '\n';
+        for (int pc = program.rowOffset[current.first];
+             pc < program.rowOffset[current.last + 1]; pc++) {
+            printInstruction(out, pc);
+        }
+        out << "\t->";
+        for (int i = 0; i < (int)current.successors.size(); i++) {
+            if (current.successors[i] == EXIT) {
+                out << " exit";
+            } else {
+                out << " B" << current.successors[i];
+            }
+        }
+        out << '\n';
+    }
+}
@@ -1,27 +1,37 @@
 #include <iostream>
 #include "lexemes.h"
+#include "tokenizer.h"
 #include "interpreter.h"
 
 using std::cout;
 using std::endl;
-using std::cerr;
 
-string Parser::getSubcodeline(int n) {
-    string str;
-    for (int i = 0; i < n && position + i < (int)code[row].size(); i++) {
-        str.push_back(code[row][position + i]);
-    }
-    return str;
+/* Rows are numbered from the start of the program; code and poliz only
+ * hold the rows from first on, which is everything since the last
+ * complete block when lines are added one at a time. */
+Parser::Parser() {
+    first = 0;
+    row = 0;
 }
 
-void Parser::shift(int n) {
-    position += n;
+string_view Parser::getName(const Token & current) const {
+    return code[row - first].substr(current.position, current.length);
+}
+
+void Parser::readRow() {
+    token = 0;
+    if (row - first < (int)code.size()) {
+        tokenize(code[row - first], tokens);
+    }
 }
 
-void Parser::skipSpaces() {
-    while (code[row][position] == ' ' || code[row][position] == '\t') {
-        position++;
+bool Parser::getOperator(OPERATOR type) {
+    if (token < (int)tokens.size() && tokens[token].kind == TOKEN_OPERATOR &&
+        tokens[token].value == type) {
+        token++;
+        return true;
     }
+    return false;
 }
 
 void Parser::buildBracketExpr() {
@@ -29,7 +39,6 @@ void Parser::buildBracketExpr() {
         newPolizline.push_back(opers.top());
         opers.pop();
     }
-    delete opers.top();
     opers.pop();
 }
 
@@ -60,62 +69,41 @@ void Parser::emptyOpersStack(STATE state /*= OKAY*/) {
     }
     if (state == ERROR) {
         while (opers.empty() == false) {
-            delete opers.top();
             opers.pop();
         }
     }
 }
 
 bool Parser::getNumber() {
-    skipSpaces();
-    int number;
-    if (isdigit(code[row][position]) == false) {
+    if (token == (int)tokens.size() || tokens[token].kind != TOKEN_NUMBER) {
         return false;
     }
-    number = code[row][position] - '0';
-    shift(1);
-    while (isdigit(code[row][position])) {
-        number = number * 10 + code[row][position] - '0';
-        shift(1);
-    }
-    newPolizline.push_back(new Number(number));
+    newPolizline.push_back(new (arena) Number(tokens[token].value));
+    token++;
     return true;
 }
 
-bool Parser::isReservedWord(string word) {
-    int n = (int)sizeof(RESERVED) / sizeof(string);
-    for (int i = 0; i < n; i++) {
-        if (word.compare(RESERVED[i]) == 0) {
-            return true;
-        }
+int Parser::getSlot(string_view name) {
+    map<string, int, std::less<>>::iterator it = slots.find(name);
+    if (it != slots.end()) {
+        return it->second;
     }
-    return false;
+    slots.emplace(name, (int)symbols.size());
+    symbols.push_back(string(name));
+    return (int)symbols.size() - 1;
 }
 
 bool Parser::getVariable() {
-    skipSpaces();
-    string name;
-    int length = 0;
-    if (isalpha(code[row][position]) == false &&
-        code[row][position] != '_') {
+    if (token == (int)tokens.size() || tokens[token].kind != TOKEN_IDENTIFIER) {
         return false;
     }
-    name.push_back(code[row][position]);
-    length++;
-    while (isalpha(code[row][position + length]) ||
-           isdigit(code[row][position + length]) ||
-           code[row][position + length] == '_') {
-        name.push_back(code[row][position + length]);
-        length++;
-    }
-    if (isReservedWord(name)) {
-        return false;
-    }
-    shift(length);
-    newPolizline.push_back(new Variable(name));
+    string_view name = getName(tokens[token]);
+    token++;
+    newPolizline.push_back(new (arena) Variable(getSlot(name)));
     if (!opers.empty() && opers.top()->getType() == GOTO) {
-        if (Goto::LabelTable.count(name) == 0) {
-            Goto::LabelTable[name] = UNDEFINED;
+        string label(name);
+        if (labels.count(label) == 0) {
+            labels[label] = UNDEFINED;
         }
         newPolizline.push_back(opers.top());
         opers.pop();
@@ -123,12 +111,48 @@ bool Parser::getVariable() {
     return true;
 }
 
+/* A built-in is a name directly followed by an opening bracket, which is
+ * otherwise a syntax error, so built-in names stay usable as variables. */
+bool Parser::getCall() {
+    if (token + 1 >= (int)tokens.size() ||
+        tokens[token].kind != TOKEN_IDENTIFIER ||
+        tokens[token + 1].kind != TOKEN_OPERATOR ||
+        tokens[token + 1].value != LBRACKET) {
+        return false;
+    }
+    string_view name = getName(tokens[token]);
+    for (int i = BUILTIN_FILL; i <= BUILTIN_COUNT; i++) {
+        if (name == BUILTIN_STRING[i]) {
+            opers.push(new (arena) Call(BUILTIN(i)));
+            token += 2;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Parser::getComma() {
+    if (getOperator(COMMA)) {
+        static_cast<Call *>(opers.top())->addArgument();
+        return true;
+    } else {
+        return false;
+    }
+}
+
+bool Parser::getEndOfCall() {
+    Call *call = static_cast<Call *>(opers.top());
+    if (call->isComplete() == false || getOperator(RBRACKET) == false) {
+        return false;
+    }
+    opers.pop();
+    newPolizline.push_back(call);
+    return true;
+}
+
 bool Parser::getAssignOperator() {
-    skipSpaces();
-    string op = getSubcodeline(2);
-    if (op.compare(OPERATOR_STRING[ASSIGN]) == 0) {
-        shift(2);
-        sortOpersRight(new Assign());
+    if (getOperator(ASSIGN)) {
+        sortOpersRight(new (arena) Assign());
         return true;
     } else {
         return false;
@@ -136,11 +160,8 @@ bool Parser::getAssignOperator() {
 }
 
 bool Parser::getLeftBracket() {
-    skipSpaces();
-    string op = getSubcodeline(1);
-    if (op.compare(OPERATOR_STRING[LBRACKET]) == 0) {
-        opers.push(new Binary(LBRACKET));
-        shift(1);
+    if (getOperator(LBRACKET)) {
+        opers.push(new (arena) Binary(LBRACKET));
         return true;
     } else {
         return false;
@@ -148,11 +169,8 @@ bool Parser::getLeftBracket() {
 }
 
 bool Parser::getRightBracket() {
-    skipSpaces();
-    string op = getSubcodeline(1);
-    if (op.compare(OPERATOR_STRING[RBRACKET]) == 0) {
+    if (getOperator(RBRACKET)) {
         buildBracketExpr();
-        shift(1);
         return true;
     } else {
         return false;
@@ -160,70 +178,44 @@ bool Parser::getRightBracket() {
 }
 
 bool Parser::getBinaryOperator() {
-    int n = (int)sizeof(OPERATOR_STRING) / sizeof(string);
-    skipSpaces();
-    for (int i = 0; i < n; i++) {
-        if (PRIORITY[i] <= 0) {
-            continue;
-        }
-        string op = getSubcodeline(OPERATOR_STRING[i].size());
-        if (op.compare(OPERATOR_STRING[i]) == 0) {
-            sortOpersLeft(new Binary(OPERATOR(i)));
-            shift(OPERATOR_STRING[i].size());
-            return true;
-        }
+    if (token < (int)tokens.size() && tokens[token].kind == TOKEN_OPERATOR &&
+        PRIORITY[tokens[token].value] > 0) {
+        sortOpersLeft(new (arena) Binary(OPERATOR(tokens[token].value)));
+        token++;
+        return true;
     }
     return false;
 }
 
 bool Parser::initLabel(string name) {
-    if (isReservedWord(name)) {
-        return false;
-    }
-    if (Goto::LabelTable.count(name) > 0 && Goto::LabelTable[name] != UNDEFINED) {
+    if (labels.count(name) > 0 && labels[name] != UNDEFINED) {
         return false;
     } else {
-        Goto::LabelTable[name] = row + 1;
+        labels[name] = row + 1;
+        newLabels.push_back(name);
         return true;
     }
 }
 
 bool Parser::getLabel() {
-    skipSpaces();
-    string name, op;
-    int length = 0;
-    if (isalpha(code[row][position]) == false &&
-        code[row][position] != '_') {
+    if (token + 1 >= (int)tokens.size() ||
+        tokens[token].kind != TOKEN_IDENTIFIER ||
+        tokens[token + 1].kind != TOKEN_OPERATOR ||
+        tokens[token + 1].value != COLON ||
+        tokens[token + 1].position != tokens[token].position + tokens[token].length) {
         return false;
     }
-    name.push_back(code[row][position]);
-    length++;
-    while (isalpha(code[row][position + length]) ||
-           isdigit(code[row][position + length]) ||
-           code[row][position + length] == '_') {
-        name.push_back(code[row][position + length]);
-        length++;
-    }
-    op.push_back(code[row][position + length]);
-    if (op.compare(OPERATOR_STRING[COLON]) == 0) {
-        name = getSubcodeline(length);
-        if (initLabel(name) == false) {
-            return false;
-        } else {
-            newPolizline.push_back(nullptr);
-            shift(length + 1);
-            return true;
-        }
+    if (initLabel(string(getName(tokens[token]))) == false) {
+        return false;
     }
-    return false;
+    newPolizline.push_back(nullptr);
+    token += 2;
+    return true;
 }
 
 bool Parser::getGoto() {
-    skipSpaces();
-    string op = getSubcodeline(4);
-    if (op.compare(OPERATOR_STRING[GOTO]) == 0) {
-        opers.push(new Goto(GOTO));
-        shift(4);
+    if (getOperator(GOTO)) {
+        opers.push(new (arena) Goto(GOTO));
         return true;
     } else {
         return false;
@@ -231,11 +223,8 @@ bool Parser::getGoto() {
 }
 
 bool Parser::getIf() {
-    skipSpaces();
-    string op = getSubcodeline(2);
-    if (op.compare(OPERATOR_STRING[IF]) == 0) {
-        opers.push(new Goto(IF));
-        shift(2);
+    if (getOperator(IF)) {
+        opers.push(new (arena) Goto(IF));
         return true;
     } else {
         return false;
@@ -243,11 +232,8 @@ bool Parser::getIf() {
 }
 
 bool Parser::getElse() {
-    skipSpaces();
-    string op = getSubcodeline(4);
-    if (op.compare(OPERATOR_STRING[ELSE]) == 0) {
-        newPolizline.push_back(new Goto(ELSE));
-        shift(4);
+    if (getOperator(ELSE)) {
+        newPolizline.push_back(new (arena) Goto(ELSE));
         return true;
     } else {
         return false;
@@ -255,11 +241,8 @@ bool Parser::getElse() {
 }
 
 bool Parser::getWhile() {
-    skipSpaces();
-    string op = getSubcodeline(5);
-    if (op.compare(OPERATOR_STRING[WHILE]) == 0) {
-        opers.push(new Goto(WHILE));
-        shift(5);
+    if (getOperator(WHILE)) {
+        opers.push(new (arena) Goto(WHILE));
         return true;
     } else {
         return false;
@@ -267,12 +250,9 @@ bool Parser::getWhile() {
 }
 
 bool Parser::getThen() {
-    skipSpaces();
-    string op = getSubcodeline(4);
-    if (op.compare(OPERATOR_STRING[THEN]) == 0) {
+    if (getOperator(THEN)) {
         newPolizline.push_back(opers.top());
         opers.pop();
-        shift(4);
         return true;
     } else {
         return false;
@@ -280,11 +260,8 @@ bool Parser::getThen() {
 }
 
 bool Parser::getEndif() {
-    skipSpaces();
-    string op = getSubcodeline(5);
-    if (op.compare(OPERATOR_STRING[ENDIF]) == 0) {
-        newPolizline.push_back(new Goto(ENDIF));
-        shift(5);
+    if (getOperator(ENDIF)) {
+        newPolizline.push_back(new (arena) Goto(ENDIF));
         return true;
     } else {
         return false;
@@ -292,11 +269,8 @@ bool Parser::getEndif() {
 }
 
 bool Parser::getEndwhile() {
-    skipSpaces();
-    string op = getSubcodeline(8);
-    if (op.compare(OPERATOR_STRING[ENDWHILE]) == 0) {
-        newPolizline.push_back(new Goto(ENDWHILE));
-        shift(8);
+    if (getOperator(ENDWHILE)) {
+        newPolizline.push_back(new (arena) Goto(ENDWHILE));
         return true;
     } else {
         return false;
@@ -304,10 +278,8 @@ bool Parser::getEndwhile() {
 }
 
 bool Parser::getLeftQBracket() {
-    string op = getSubcodeline(1);
-    if (op.compare(OPERATOR_STRING[LQBRACKET]) == 0) {
-        opers.push(new Binary(LQBRACKET));
-        shift(1);
+    if (getOperator(LQBRACKET)) {
+        opers.push(new (arena) Binary(LQBRACKET));
         return true;
     } else {
         return false;
@@ -315,334 +287,213 @@ bool Parser::getLeftQBracket() {
 }
 
 bool Parser::getRightQBracket() {
-    string op = getSubcodeline(1);
-    if (op.compare(OPERATOR_STRING[RQBRACKET]) == 0) {
-        shift(1);
-        delete opers.top();
+    if (getOperator(RQBRACKET)) {
         opers.pop();
-        newPolizline.push_back(new Dereference());
+        newPolizline.push_back(new (arena) Dereference());
         return true;
     } else {
         return false;
     }
 }
 
+/* Operands and operators alternate. An open bracket or built-in call leaves
+ * its marker on the operator stack, so nesting is tracked there instead of
+ * by recursion. */
 bool Parser::getExpression() {
-    if (getNumber()) {
-        if (getBinaryOperator()) {
-            return getExpression();
+    bool assignable;
+    while (true) {
+        if (getNumber()) {
+            assignable = false;
+        } else if (getCall()) {
+            continue;
+        } else if (getVariable()) {
+            if (getLeftQBracket()) {
+                continue;
+            }
+            assignable = true;
+        } else if (getLeftBracket() == false) {
+            return false;
         } else {
-            emptyOpersStack();
-            return true;
+            continue;
         }
-    } else if (getVariable()) {
-        if (getAssignOperator() || getBinaryOperator()) {
-            return getExpression();
-        } else if (getLeftQBracket() && getExpression() && getRightQBracket()) {
-            if (getAssignOperator() || getBinaryOperator()) {
-                return getExpression();
+        while ((assignable && getAssignOperator()) == false &&
+               getBinaryOperator() == false) {
+            emptyOpersStack();
+            if (opers.empty()) {
+                return true;
+            } else if (opers.top()->getType() == LBRACKET) {
+                if (getRightBracket() == false) {
+                    return false;
+                }
+                assignable = false;
+            } else if (opers.top()->getType() == LQBRACKET) {
+                if (getRightQBracket() == false) {
+                    return false;
+                }
+                assignable = true;
+            } else if (opers.top()->getType() == CALL) {
+                if (getComma()) {
+                    break;
+                }
+                if (getEndOfCall() == false) {
+                    return false;
+                }
+                assignable = false;
             } else {
-                emptyOpersStack();
                 return true;
             }
-        } else {
-            emptyOpersStack();
-            return true;
-        }
-    } else if (getLeftBracket() && getExpression() && getRightBracket()) {
-        if (getBinaryOperator()) {
-            return getExpression();
-        } else {
-            emptyOpersStack();
-            return true;
         }
     }
-    return false;
 }
 
 void Parser::putCommandInPoliz() {
     poliz.push_back(newPolizline);
     newPolizline.clear();
     row++;
-    position = 0;
+    readRow();
 }
 
 bool Parser::isEndOfLine() {
-    if (position == (int)code[row].size()) {
-        return true;
-    } else {
+    return token == (int)tokens.size();
+}
+
+bool Parser::openBlock(OPERATOR type) {
+    blocks.push_back({type, row});
+    putCommandInPoliz();
+    return true;
+}
+
+bool Parser::getElseBlock() {
+    if (blocks.empty() || blocks.back().type != IF) {
         return false;
     }
+    static_cast<Goto *>(poliz[blocks.back().row - first].back())->setRow(row + 1);
+    blocks.back() = {ELSE, row};
+    putCommandInPoliz();
+    return true;
 }
 
-bool Parser::getIfBlock() {
-    int ifRow;
-    if (getIf() && getExpression() && getThen() && isEndOfLine()) {
-        ifRow = row;
-        putCommandInPoliz();
-        if (getSequenceOfCommands() && newPolizline.empty() == false) {
-            Goto *iflexem = dynamic_cast<Goto *>(newPolizline.front());
-            if (iflexem != nullptr && iflexem->getType() == ELSE) {
-                dynamic_cast<Goto *>(poliz[ifRow].back())->setRow(row + 1);
-                ifRow = row;
-                putCommandInPoliz();
-                if (getSequenceOfCommands() == false || newPolizline.empty()) {
-                    return false;
-                }
-                iflexem = dynamic_cast<Goto *>(newPolizline.front());
-            }
-            if (iflexem != nullptr && iflexem->getType() == ENDIF) {
-                delete iflexem;
-                newPolizline.clear();
-                newPolizline.push_back(nullptr);
-                putCommandInPoliz();
-                dynamic_cast<Goto *>(poliz[ifRow].back())->setRow(row);
-                return true;
-            }
-        }
+bool Parser::closeIfBlock() {
+    if (blocks.empty() || blocks.back().type == WHILE) {
+        return false;
     }
-    return false;
+    newPolizline.clear();
+    newPolizline.push_back(nullptr);
+    putCommandInPoliz();
+    static_cast<Goto *>(poliz[blocks.back().row - first].back())->setRow(row);
+    blocks.pop_back();
+    return true;
 }
 
-bool Parser::getWhileBlock() {
-    int whileRow;
-    if (getWhile() && getExpression() && getThen() && isEndOfLine()) {
-        whileRow = row;
-        putCommandInPoliz();
-        if (getSequenceOfCommands() && newPolizline.empty() == false) {
-            Goto *endwhile = dynamic_cast<Goto *>(newPolizline.front());
-            if (endwhile == nullptr || endwhile->getType() != ENDWHILE) {
-                return false;
-            }
-            dynamic_cast<Goto *>(endwhile)->setRow(whileRow);
-            putCommandInPoliz();
-            dynamic_cast<Goto *>(poliz[whileRow].back())->setRow(row);
-            return true;
-        }
+bool Parser::closeWhileBlock() {
+    if (blocks.empty() || blocks.back().type != WHILE) {
+        return false;
     }
-    return false;
+    static_cast<Goto *>(newPolizline.back())->setRow(blocks.back().row);
+    putCommandInPoliz();
+    static_cast<Goto *>(poliz[blocks.back().row - first].back())->setRow(row);
+    blocks.pop_back();
+    return true;
 }
 
+/* Every line is recognised by its first token, and if / else / while
+ * nesting lives on the block stack, so parsing is a single loop. */
 bool Parser::getCommand() {
-    if (code[row].empty() == true) {
+    if (code[row - first].empty()) {
         newPolizline.push_back(nullptr);
         putCommandInPoliz();
         return true;
-    } else if (((getGoto() && getVariable()) || getLabel() ||
-          getExpression()) && isEndOfLine()) {
-        putCommandInPoliz();
-        return true;
-    } else {
+    } else if (getIf()) {
+        return getExpression() && getThen() && isEndOfLine() && openBlock(IF);
+    } else if (getWhile()) {
+        return getExpression() && getThen() && isEndOfLine() &&
+               openBlock(WHILE);
+    } else if (getElse()) {
+        return isEndOfLine() && getElseBlock();
+    } else if (getEndif()) {
+        return isEndOfLine() && closeIfBlock();
+    } else if (getEndwhile()) {
+        return isEndOfLine() && closeWhileBlock();
+    } else if (getGoto()) {
+        if (getVariable() == false || isEndOfLine() == false) {
+            return false;
+        }
+    } else if ((getLabel() || getExpression()) == false || isEndOfLine() == false) {
         return false;
     }
+    putCommandInPoliz();
+    return true;
 }
 
 void Parser::freePoliz(STATE state /*= OKAY*/) {
     if (state == ERROR) {
         emptyOpersStack(ERROR);
-        poliz.push_back(newPolizline);
-    }
-    for (int i = 0; i < (int)poliz.size(); i++) {
-        for (int j = 0; j < (int)poliz[i].size(); j++) {
-            delete poliz[i][j];
-        }
-        poliz[i].clear();
+        newPolizline.clear();
+        blocks.clear();
     }
     poliz.clear();
+    code.clear();
+    newLabels.clear();
+    first = row;
+    arena.release();
 }
 
-
-bool Parser::getSequenceOfCommands() {
-    if (row == (int)code.size()) {
-        return true;
-    } else if ((getEndwhile() || getEndif() || getElse()) && isEndOfLine()) {
+bool Parser::addLine(string_view line, ostream & err /*= std::cerr*/) {
+    code.push_back(line);
+    readRow();
+    if (getCommand()) {
         return true;
-    } else if (getCommand() || getWhileBlock() || getIfBlock()) {
-        return getSequenceOfCommands();
-    } else {
-        return false;
     }
+    err << '\n' <<"#######" << '\n' <<
+        "Syntax error: line " << row + 1 << endl;
+    discard();
+    return false;
+}
+
+bool Parser::isComplete() const {
+    return blocks.empty();
+}
+
+/* Forgets every line since the last complete block, including the labels
+ * they defined. */
+void Parser::discard() {
+    for (int i = 0; i < (int)newLabels.size(); i++) {
+        labels[newLabels[i]] = UNDEFINED;
+    }
+    row = first;
+    freePoliz(ERROR);
 }
 
-bool Parser::buildPoliz(vector<string> code) {
+bool Parser::buildPoliz(const vector<string_view> & code,
+                        ostream & err /*= std::cerr*/) {
     Parser::code = code;
+    first = 0;
     row = 0;
-    position = 0;
-    if (getSequenceOfCommands() && (row == (int)code.size())) {
+    readRow();
+    while (row < (int)code.size() && getCommand()) {
+    }
+    if (row == (int)code.size() && blocks.empty()) {
         return true;
     } else {
         freePoliz(ERROR);
-        cerr << '\n' <<"#######" << '\n' <<
+        err << '\n' <<"#######" << '\n' <<
             "Syntax error: line " << row + 1 << endl;
         return false;
     }
 }
 
-int getRightArgument(Lexem *operand) {
-    if (dynamic_cast<Number *>(operand)) {
-        return dynamic_cast<Number *>(operand)->getValue();
-    } else if (dynamic_cast<Variable *>(operand)) {
-        return dynamic_cast<Variable *>(operand)->getValue();
-    } else {
-        return dynamic_cast<ArrayElem *>(operand)->getValue();
-    }
-}
-
-Lexem *performAssignment(Lexem *leftArg, int rightArg, Assign *assign) {
-    Lexem *result;
-    if (dynamic_cast<Variable *>(leftArg)) {
-            Variable *left = dynamic_cast<Variable *>(leftArg);
-            result = new Number(assign->getValue(*left, rightArg));
-        } else {
-            ArrayElem *leftArr = dynamic_cast<ArrayElem *>(leftArg);
-            result = new Number(assign->getValue(*leftArr, rightArg));
-        }
-    return result;
-}
-
-Lexem *performDereference(Lexem *leftArg, int rightArg, Dereference *deref) {
-    Lexem *result;
-    string arrName = dynamic_cast<Variable *>(leftArg)->getName();
-    result = deref->getValue(arrName, rightArg);
-    return result;
-}
-
-Lexem *performCalculation(Lexem *leftArg, int rightArg, Binary *binary) {
-    Lexem *result;
-    if (dynamic_cast<Number *>(leftArg)) {
-        int leftNum = dynamic_cast<Number *>(leftArg)->getValue();
-        result = new Number(binary->getValue(leftNum, rightArg));
-    } else if (dynamic_cast<Variable *>(leftArg)) {
-        int leftVar = dynamic_cast<Variable *>(leftArg)->getValue();
-        result = new Number(binary->getValue(leftVar, rightArg));
-    } else {
-        int leftArrElem = dynamic_cast<ArrayElem *>(leftArg)->getValue();
-        result = new Number(binary->getValue(leftArrElem, rightArg));
-    }
-    return result;
-}
-
-Lexem *currentResult(stack<Lexem *> & eval, Lexem *op) {
-    Lexem *result;
-    Binary *binary = dynamic_cast<Binary *>(op);
-    Assign *assign = dynamic_cast<Assign *>(op);
-    Dereference *deref = dynamic_cast<Dereference *>(op);
-    int rightArg = getRightArgument(eval.top());
-    eval.pop();
-    if (eval.empty()) {
-        result = new Number(rightArg);
-        return result;
-    }
-    if (assign != nullptr) {
-        result = performAssignment(eval.top(), rightArg, assign);
-    } else if (deref != nullptr) {
-        result = performDereference(eval.top(), rightArg, deref);
-    } else {
-        result = performCalculation(eval.top(), rightArg, binary);
-    }
-    eval.pop();
-    return result;
-}
-
-bool getCondition(Lexem *condition) {
-    Variable *var = dynamic_cast<Variable *>(condition);
-    Number *num = dynamic_cast<Number *>(condition);
-    if (var) {
-        return !(var->getValue() == 0);
-    }
-    return !(num->getValue() == 0);
-}
-
-int jump(Goto *op, stack<Lexem *> & eval, size_t row) {
-    OPERATOR type = op->getType();
-    bool condition = false;
-    if (type == GOTO) {
-        Variable *label = dynamic_cast<Variable *>(eval.top());
-        return op->getValue(*label);
-    }
-    if (eval.empty() == false) {
-        condition = getCondition(eval.top());
-    }
-    if (type == IF || type == WHILE) {
-        if (condition == false) {
-            return op->getRow();
-        } else {
-            return row + 1;
-        }
-    }
-    return op->getRow();
-}
-
-int evaluatePoliz(vector<Lexem *> poliz, int row) {
-    int value, nextRow = row + 1;
-    stack<Lexem *> eval;
-    vector<Lexem *> temporary;
-    for (int i = 0; i < (int)poliz.size(); i++) {
-        if (poliz[i] == nullptr) {
-            continue;
-        } else if (dynamic_cast<Number *>(poliz[i]) ||
-                   dynamic_cast<Variable *>(poliz[i])) {
-            eval.push(poliz[i]);
-        } else if (dynamic_cast<Goto *>(poliz[i])) {
-            nextRow = jump(dynamic_cast<Goto *>(poliz[i]), eval, row);
-        } else {
-            temporary.push_back(currentResult(eval, poliz[i]));
-            eval.push(temporary.back());
-        }
-    }
-    if (eval.empty() == false) {
-        if (dynamic_cast<ArrayElem *>(eval.top())) {
-            value = dynamic_cast<ArrayElem *>(eval.top())->getValue();
-            cout << value << endl;
-        }
-        if (dynamic_cast<Number *>(eval.top())) {
-            value = dynamic_cast<Number *>(eval.top())->getValue();
-            cout << value << endl;
-        }
-    }
-    for (int i = 0; i < (int)temporary.size(); i++) {
-        delete temporary[i];
-    }
-    return nextRow;
-}
-
-void print(vector<Lexem *> v) {
+void print(vector<Lexem *> v, const vector<string> & symbols) {
     vector<Lexem *>::iterator it;
-    int n = (int)sizeof(OPERATOR_STRING) / sizeof(string);
     for (it = v.begin(); it != v.end(); it++) {
         if (*it == nullptr) {
             continue;
         } else if (dynamic_cast<Number *>(*it)) {
             cout << "[" <<dynamic_cast<Number *>(*it)->getValue() << "] ";
         } else if (dynamic_cast<Variable *>(*it)) {
-            cout << "[" << dynamic_cast<Variable *>(*it)->getName() << "] ";
-        } else {
-            for (int i = 0; i < n; i++) {
-                if (dynamic_cast<Oper *>(*it)->getType() == OPERATOR(i)) {
-                    cout << "[" << OPERATOR_STRING[i] << "] ";
-                }
-            }
+            cout << "[" << symbols[dynamic_cast<Variable *>(*it)->getSlot()] << "] ";
+        } else if ((*it)->isOperator()) {
+            cout << "[" << OPERATOR_STRING[static_cast<Oper *>(*it)->getType()] << "] ";
         }
     }
     cout << endl;
 }
-
-void printMap() {
-    map<string, int>::iterator it;
-    map<string, vector<int>>::iterator it2;
-    cout << "--------Variables--------" << endl;
-    for (it = Variable::VarTable.begin(); it != Variable::VarTable.end(); it++) {
-        cout << it->first << " = " << it->second << endl;
-    }
-    cout << "-------------------------" << endl;
-    cout << "----------Arrays---------" << endl;
-    for (it2 = ArrayElem::ArrayTable.begin(); it2 != ArrayElem::ArrayTable.end(); it2++) {
-        cout << it2->first << ": ";
-        for (int i = 0; i < (int)ArrayElem::ArrayTable[it2->first].size(); i++) {
-            cout << "[" << ArrayElem::ArrayTable[it2->first][i] << "] ";
-        }
-        cout << endl;
-    }
-    cout << "-------------------------" << endl;
-}
-
@@ -0,0 +1,528 @@
+#include <cstring>
+#include <sys/mman.h>
+#include "lexemes.h"
+#include "program.h"
+#include "jit.h"
+
+using std::endl;
+
+enum REGISTER {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+enum CONDITION {
+    ALWAYS = -1,
+    CC_E = 0x4, CC_NE = 0x5,
+    CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF
+};
+
+/* Generated code keeps the Interpreter in rbx, the value stack in r12, the
+ * variables in r13 and the defined / dirty flags in r14 / r15. Stack depth
+ * is known for every instruction, so stack cells are fixed offsets from r12.
+ * Arrays, printing and errors go through the static helpers below. */
+Jit::Jit(const Program & program) : program(program) {
+    buffer = nullptr;
+    bufferSize = 0;
+}
+
+Jit::~Jit() {
+    if (buffer != nullptr) {
+        munmap(buffer, bufferSize);
+    }
+}
+
+int Jit::loadElement(Interpreter *interpreter, int slot, int index) {
+    return interpreter->arrays[slot].load(index);
+}
+
+void Jit::storeElement(Interpreter *interpreter, int slot, int index,
+                       int value) {
+    interpreter->arrayDirty[slot] = true;
+    interpreter->arrays[slot].store(index, value);
+}
+
+int Jit::callBuiltin(Interpreter *interpreter, int builtin,
+                     const int *args) {
+    return interpreter->call(builtin, args);
+}
+
+void Jit::print(Interpreter *interpreter, int value) {
+    interpreter->out << value << '\n';
+}
+
+void Jit::undefinedLabel(Interpreter *interpreter, int slot) {
+    interpreter->err << "Error: undefined label " <<
+        interpreter->program.symbols[slot] << endl;
+}
+
+void Jit::divisionByZero(Interpreter *interpreter, int row) {
+    interpreter->err << "Error: division by zero at line " <<
+        interpreter->program.lines[row] + 1 << endl;
+    interpreter->failed = true;
+}
+
+void Jit::emitByte(int byte) {
+    code.push_back((unsigned char)byte);
+}
+
+void Jit::emitInt(int value) {
+    for (int i = 0; i < 4; i++) {
+        emitByte((unsigned)value >> (8 * i));
+    }
+}
+
+void Jit::emitRex(bool wide, int reg, int base) {
+    int rex = 0x40 | (wide << 3) | ((reg >> 3) << 2) | (base >> 3);
+    if (rex != 0x40) {
+        emitByte(rex);
+    }
+}
+
+void Jit::emitMemory(int reg, int base, int disp) {
+    emitByte(0x80 | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == RSP) {
+        emitByte(0x24);
+    }
+    emitInt(disp);
+}
+
+void Jit::emitLoad(int reg, int base, int disp) {
+    emitRex(false, reg, base);
+    emitByte(0x8B);
+    emitMemory(reg, base, disp);
+}
+
+void Jit::emitStore(int base, int disp, int reg) {
+    emitRex(false, reg, base);
+    emitByte(0x89);
+    emitMemory(reg, base, disp);
+}
+
+void Jit::emitSetFlag(int base, int disp) {
+    emitRex(false, 0, base);
+    emitByte(0xC6);
+    emitMemory(0, base, disp);
+    emitByte(1);
+}
+
+void Jit::emitMoveImmediate(int reg, int value) {
+    emitRex(false, 0, reg);
+    emitByte(0xB8 + (reg & 7));
+    emitInt(value);
+}
+
+void Jit::emitMove64(int dst, int src) {
+    emitRex(true, src, dst);
+    emitByte(0x89);
+    emitByte(0xC0 | ((src & 7) << 3) | (dst & 7));
+}
+
+void Jit::emitCall(const void *function) {
+    unsigned long long address = (unsigned long long)function;
+    emitByte(0x48);
+    emitByte(0xB8);
+    emitInt((int)address);
+    emitInt((int)(address >> 32));
+    emitByte(0xFF);
+    emitByte(0xD0);
+}
+
+void Jit::emitJump(int condition, int row) {
+    if (condition == ALWAYS) {
+        emitByte(0xE9);
+    } else {
+        emitByte(0x0F);
+        emitByte(0x80 + condition);
+    }
+    patches.push_back({(int)code.size(), row});
+    emitInt(0);
+}
+
+void Jit::emitCompare(int condition) {
+    emitByte(0x0F);
+    emitByte(0x90 + condition);
+    emitByte(0xC0);
+    emitByte(0x0F);
+    emitByte(0xB6);
+    emitByte(0xC0);
+}
+
+/* Leaves the program with an error unless ecx is non-zero. */
+void Jit::emitDivisorCheck(int row) {
+    emitByte(0x85);
+    emitByte(0xC9);
+    emitByte(0x75);
+    int skip = (int)code.size();
+    emitByte(0);
+    emitMove64(RDI, RBX);
+    emitMoveImmediate(RSI, row);
+    emitCall((const void *)&Jit::divisionByZero);
+    emitJump(ALWAYS, program.size());
+    code[skip] = (unsigned char)(code.size() - (skip + 1));
+}
+
+void Jit::emitPrint(int depth) {
+    emitMove64(RDI, RBX);
+    emitLoad(RSI, R12, 4 * (depth - 1));
+    emitCall((const void *)&Jit::print);
+}
+
+static int getCondition(OPCODE opcode) {
+    switch (opcode) {
+        case OP_EQ:
+        case OP_BRANCH_EQ:
+            return CC_E;
+        case OP_NEQ:
+        case OP_BRANCH_NEQ:
+            return CC_NE;
+        case OP_LEQ:
+        case OP_BRANCH_LEQ:
+            return CC_LE;
+        case OP_LT:
+        case OP_BRANCH_LT:
+            return CC_L;
+        case OP_GEQ:
+        case OP_BRANCH_GEQ:
+            return CC_GE;
+        default:
+            return CC_G;
+    }
+}
+
+/* eax = eax op ecx */
+bool Jit::compileBinary(OPCODE opcode) {
+    switch (opcode) {
+        case OP_OR:
+            emitByte(0x09);
+            emitByte(0xC8);
+            emitCompare(CC_NE);
+            break;
+        case OP_AND:
+            emitByte(0x85);
+            emitByte(0xC0);
+            emitByte(0x0F);
+            emitByte(0x95);
+            emitByte(0xC0);
+            emitByte(0x85);
+            emitByte(0xC9);
+            emitByte(0x0F);
+            emitByte(0x95);
+            emitByte(0xC1);
+            emitByte(0x20);
+            emitByte(0xC8);
+            emitByte(0x0F);
+            emitByte(0xB6);
+            emitByte(0xC0);
+            break;
+        case OP_BITOR:
+            emitByte(0x09);
+            emitByte(0xC8);
+            break;
+        case OP_XOR:
+            emitByte(0x31);
+            emitByte(0xC8);
+            break;
+        case OP_BITAND:
+            emitByte(0x21);
+            emitByte(0xC8);
+            break;
+        case OP_EQ:
+        case OP_NEQ:
+        case OP_LEQ:
+        case OP_LT:
+        case OP_GEQ:
+        case OP_GT:
+            emitByte(0x39);
+            emitByte(0xC8);
+            emitCompare(getCondition(opcode));
+            break;
+        case OP_SHL:
+            emitByte(0xD3);
+            emitByte(0xE0);
+            break;
+        case OP_SHR:
+            emitByte(0xD3);
+            emitByte(0xF8);
+            break;
+        case OP_PLUS:
+            emitByte(0x01);
+            emitByte(0xC8);
+            break;
+        case OP_MINUS:
+            emitByte(0x29);
+            emitByte(0xC8);
+            break;
+        case OP_MULT:
+            emitByte(0x0F);
+            emitByte(0xAF);
+            emitByte(0xC1);
+            break;
+        case OP_DIV:
+        case OP_MOD:
+            /* A divisor of -1 negates (wrapping INT_MIN) or gives 0 without
+             * idiv, which would trap on INT_MIN. */
+            emitByte(0x83);
+            emitByte(0xF9);
+            emitByte(0xFF);
+            emitByte(0x75);
+            emitByte(0x04);
+            if (opcode == OP_DIV) {
+                emitByte(0xF7);
+                emitByte(0xD8);
+            } else {
+                emitByte(0x31);
+                emitByte(0xC0);
+            }
+            emitByte(0xEB);
+            emitByte(opcode == OP_DIV ? 0x03 : 0x05);
+            emitByte(0x99);
+            emitByte(0xF7);
+            emitByte(0xF9);
+            if (opcode == OP_MOD) {
+                emitByte(0x89);
+                emitByte(0xD0);
+            }
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+/* eax = eax / 2^shift, rounded towards zero; clobbers ecx */
+static void emitDivPow2(vector<unsigned char> & code, int shift) {
+    unsigned char bytes[] = {
+        0x89, 0xC1,
+        0xC1, 0xF9, 0x1F,
+        0x81, 0xE1, 0, 0, 0, 0,
+        0x01, 0xC8,
+        0xC1, 0xF8, (unsigned char)shift
+    };
+    unsigned mask = (1u << shift) - 1;
+    memcpy(bytes + 7, &mask, 4);
+    code.insert(code.end(), bytes, bytes + sizeof(bytes));
+}
+
+bool Jit::compileRow(int row) {
+    int depth = 0;
+    for (int pc = program.rowOffset[row]; pc < program.rowOffset[row + 1]; pc++) {
+        const Instruction & instruction = program.code[pc];
+        int slot = instruction.operand;
+        switch (instruction.opcode) {
+            case OP_PUSH_NUM:
+                emitMoveImmediate(RAX, instruction.operand);
+                emitStore(R12, 4 * depth++, RAX);
+                break;
+            case OP_LOAD:
+            case OP_LOAD_UNDER:
+                emitSetFlag(R14, slot);
+                emitLoad(RAX, R13, 4 * slot);
+                if (instruction.opcode == OP_LOAD) {
+                    emitStore(R12, 4 * depth++, RAX);
+                } else {
+                    emitStore(R12, 4 * (depth - 2), RAX);
+                }
+                break;
+            case OP_LOAD_ELEM:
+            case OP_LOAD_ELEM_UNDER: {
+                int cell = instruction.opcode == OP_LOAD_ELEM ? depth - 1 : depth - 2;
+                emitMove64(RDI, RBX);
+                emitMoveImmediate(RSI, slot);
+                emitLoad(RDX, R12, 4 * cell);
+                emitCall((const void *)&Jit::loadElement);
+                emitStore(R12, 4 * cell, RAX);
+                break;
+            }
+            case OP_MULT_POW2:
+                emitLoad(RAX, R12, 4 * (depth - 1));
+                emitByte(0xC1);
+                emitByte(0xE0);
+                emitByte(instruction.operand);
+                emitStore(R12, 4 * (depth - 1), RAX);
+                break;
+            case OP_DIV_POW2:
+                emitLoad(RAX, R12, 4 * (depth - 1));
+                emitDivPow2(code, instruction.operand);
+                emitStore(R12, 4 * (depth - 1), RAX);
+                break;
+            case OP_MOD_POW2:
+                emitLoad(RAX, R12, 4 * (depth - 1));
+                emitByte(0x89);
+                emitByte(0xC2);
+                emitDivPow2(code, instruction.operand);
+                emitByte(0xC1);
+                emitByte(0xE0);
+                emitByte(instruction.operand);
+                emitByte(0x29);
+                emitByte(0xC2);
+                emitStore(R12, 4 * (depth - 1), RDX);
+                break;
+            case OP_STORE:
+                emitSetFlag(R14, slot);
+                emitSetFlag(R15, slot);
+                emitLoad(RAX, R12, 4 * (depth - 1));
+                emitStore(R13, 4 * slot, RAX);
+                break;
+            case OP_STORE_ELEM:
+                emitMove64(RDI, RBX);
+                emitMoveImmediate(RSI, slot);
+                emitLoad(RDX, R12, 4 * (depth - 2));
+                emitLoad(RCX, R12, 4 * (depth - 1));
+                emitCall((const void *)&Jit::storeElement);
+                emitLoad(RAX, R12, 4 * (depth - 1));
+                emitStore(R12, 4 * (depth - 2), RAX);
+                depth--;
+                break;
+            case OP_CALL:
+                depth -= instruction.argument;
+                emitMove64(RDI, RBX);
+                emitMoveImmediate(RSI, instruction.operand);
+                emitRex(true, RDX, R12);
+                emitByte(0x8D);
+                emitMemory(RDX, R12, 4 * depth);
+                emitCall((const void *)&Jit::callBuiltin);
+                emitStore(R12, 4 * depth++, RAX);
+                break;
+            case OP_INC:
+            case OP_UPDATE_MULT:
+                emitSetFlag(R14, slot);
+                emitSetFlag(R15, slot);
+                emitLoad(RAX, R13, 4 * slot);
+                if (instruction.opcode == OP_INC) {
+                    emitByte(0x05);
+                } else {
+                    emitByte(0x69);
+                    emitByte(0xC0);
+                }
+                emitInt(instruction.argument);
+                emitStore(R13, 4 * slot, RAX);
+                emitStore(R12, 4 * depth++, RAX);
+                break;
+            case OP_LOAD_MOD:
+                emitSetFlag(R14, slot);
+                emitLoad(RAX, R13, 4 * slot);
+                emitMoveImmediate(RCX, instruction.argument);
+                compileBinary(OP_MOD);
+                emitStore(R12, 4 * depth++, RAX);
+                break;
+            case OP_PRINT:
+                emitPrint(depth);
+                break;
+            case OP_END:
+                break;
+            case OP_JUMP:
+                emitJump(ALWAYS, instruction.operand);
+                break;
+            case OP_JUMP_FALSE:
+                emitLoad(RAX, R12, 4 * (depth - 1));
+                emitByte(0x85);
+                emitByte(0xC0);
+                emitJump(CC_E, instruction.operand);
+                break;
+            case OP_GOTO:
+                if (program.labels[slot] == UNDEFINED) {
+                    emitMove64(RDI, RBX);
+                    emitMoveImmediate(RSI, slot);
+                    emitCall((const void *)&Jit::undefinedLabel);
+                    emitJump(ALWAYS, program.size());
+                } else {
+                    emitJump(ALWAYS, program.labels[slot]);
+                }
+                break;
+            case OP_BRANCH_EQ:
+            case OP_BRANCH_NEQ:
+            case OP_BRANCH_LEQ:
+            case OP_BRANCH_LT:
+            case OP_BRANCH_GEQ:
+            case OP_BRANCH_GT:
+                emitLoad(RAX, R12, 4 * (depth - 1));
+                emitByte(0x3D);
+                emitInt(instruction.operand);
+                emitCompare(getCondition(instruction.opcode));
+                emitStore(R12, 4 * (depth - 1), RAX);
+                emitPrint(depth);
+                emitLoad(RAX, R12, 4 * (depth - 1));
+                emitByte(0x85);
+                emitByte(0xC0);
+                emitJump(CC_E, instruction.argument);
+                break;
+            default:
+                emitLoad(RAX, R12, 4 * (depth - 2));
+                emitLoad(RCX, R12, 4 * (depth - 1));
+                if (instruction.opcode == OP_DIV || instruction.opcode == OP_MOD) {
+                    emitDivisorCheck(row);
+                }
+                if (compileBinary(instruction.opcode) == false) {
+                    return false;
+                }
+                emitStore(R12, 4 * (depth - 2), RAX);
+                depth--;
+                break;
+        }
+    }
+    return true;
+}
+
+bool Jit::compile() {
+#if defined(__x86_64__)
+    code.clear();
+    patches.clear();
+    rowStart.assign(program.size() + 1, 0);
+    emitByte(0x53);
+    for (int reg = R12; reg <= R15; reg++) {
+        emitRex(false, 0, reg);
+        emitByte(0x50 + (reg & 7));
+    }
+    emitMove64(RBX, RDI);
+    emitMove64(R12, RSI);
+    emitMove64(R13, RDX);
+    emitMove64(R14, RCX);
+    emitMove64(R15, R8);
+    emitByte(0x41);
+    emitByte(0xFF);
+    emitByte(0xE1);
+    for (int row = 0; row < program.size(); row++) {
+        rowStart[row] = (int)code.size();
+        if (compileRow(row) == false) {
+            return false;
+        }
+    }
+    rowStart[program.size()] = (int)code.size();
+    for (int reg = R15; reg >= R12; reg--) {
+        emitRex(false, 0, reg);
+        emitByte(0x58 + (reg & 7));
+    }
+    emitByte(0x5B);
+    emitByte(0xC3);
+    for (int i = 0; i < (int)patches.size(); i++) {
+        int position = patches[i].first;
+        int target = rowStart[patches[i].second] - (position + 4);
+        memcpy(&code[position], &target, 4);
+    }
+    bufferSize = code.size();
+    buffer = mmap(nullptr, bufferSize, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED) {
+        buffer = nullptr;
+        return false;
+    }
+    memcpy(buffer, code.data(), bufferSize);
+    if (mprotect(buffer, bufferSize, PROT_READ | PROT_EXEC) != 0) {
+        munmap(buffer, bufferSize);
+        buffer = nullptr;
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Jit::run(Interpreter & interpreter) {
+    Entry entry = (Entry)buffer;
+    entry(&interpreter, interpreter.stack.data(), interpreter.variables.data(),
+          interpreter.defined.data(), interpreter.dirty.data(),
+          (char *)buffer + rowStart[interpreter.row]);
+    interpreter.row = program.size();
+}
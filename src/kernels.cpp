@@ -0,0 +1,251 @@
+#include <algorithm>
+#include "lexemes.h"
+#include "kernels.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define VECTORIZED
+#define AVX2 __attribute__((target("avx2")))
+#endif
+
+/* Each kernel runs whole blocks of eight elements through AVX2 when the
+ * CPU has it and leaves the tail, or everything on other machines, to the
+ * scalar loop. Arithmetic wraps around like the bytecode does. */
+int combine(OPERATOR type, int left, int right) {
+    switch (type) {
+        case PLUS:
+            return (int)((unsigned)left + (unsigned)right);
+        case MINUS:
+            return (int)((unsigned)left - (unsigned)right);
+        case MULT:
+            return (int)((unsigned)left * (unsigned)right);
+        case BITAND:
+            return left & right;
+        case BITOR:
+            return left | right;
+        default:
+            return left ^ right;
+    }
+}
+
+#define SCALAR_LOOP(type, operation, right) \
+        case type: \
+            for (; i < n; i++) { \
+                data[i] = (int)((unsigned)data[i] operation (unsigned)(right)); \
+            } \
+            break;
+
+#define SCALAR_CASES(right) \
+        SCALAR_LOOP(PLUS, +, right) \
+        SCALAR_LOOP(MINUS, -, right) \
+        SCALAR_LOOP(MULT, *, right) \
+        SCALAR_LOOP(BITAND, &, right) \
+        SCALAR_LOOP(BITOR, |, right) \
+        SCALAR_LOOP(XOR, ^, right)
+
+#ifdef VECTORIZED
+#define VECTOR_LOOP(type, intrinsic, right) \
+        case type: \
+            for (; i + 8 <= n; i += 8) { \
+                __m256i *cell = (__m256i *)(data + i); \
+                _mm256_storeu_si256(cell, intrinsic(_mm256_loadu_si256(cell), right)); \
+            } \
+            break;
+
+#define VECTOR_CASES(right) \
+        VECTOR_LOOP(PLUS, _mm256_add_epi32, right) \
+        VECTOR_LOOP(MINUS, _mm256_sub_epi32, right) \
+        VECTOR_LOOP(MULT, _mm256_mullo_epi32, right) \
+        VECTOR_LOOP(BITAND, _mm256_and_si256, right) \
+        VECTOR_LOOP(BITOR, _mm256_or_si256, right) \
+        VECTOR_LOOP(XOR, _mm256_xor_si256, right)
+
+static bool hasAvx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+AVX2 static int fillAvx2(int *data, int n, int value) {
+    __m256i broadcast = _mm256_set1_epi32(value);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_si256((__m256i *)(data + i), broadcast);
+    }
+    return i;
+}
+
+AVX2 static int combineArraysAvx2(OPERATOR type, int *data, const int *other,
+                                  int n) {
+    int i = 0;
+    switch (type) {
+        VECTOR_CASES(_mm256_loadu_si256((const __m256i *)(other + i)))
+        default:
+            break;
+    }
+    return i;
+}
+
+AVX2 static int combineValueAvx2(OPERATOR type, int *data, int value, int n) {
+    __m256i broadcast = _mm256_set1_epi32(value);
+    int i = 0;
+    switch (type) {
+        VECTOR_CASES(broadcast)
+        default:
+            break;
+    }
+    return i;
+}
+
+AVX2 static int sumAvx2(const int *data, int n, int & result) {
+    __m256i sum = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        sum = _mm256_add_epi32(sum, _mm256_loadu_si256((const __m256i *)(data + i)));
+    }
+    int lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, sum);
+    for (int k = 0; k < 8; k++) {
+        result = (int)((unsigned)result + (unsigned)lanes[k]);
+    }
+    return i;
+}
+
+AVX2 static int minAvx2(const int *data, int n, int & result) {
+    __m256i minimum = _mm256_set1_epi32(result);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        minimum = _mm256_min_epi32(minimum,
+                                   _mm256_loadu_si256((const __m256i *)(data + i)));
+    }
+    int lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, minimum);
+    result = *std::min_element(lanes, lanes + 8);
+    return i;
+}
+
+AVX2 static int maxAvx2(const int *data, int n, int & result) {
+    __m256i maximum = _mm256_set1_epi32(result);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        maximum = _mm256_max_epi32(maximum,
+                                   _mm256_loadu_si256((const __m256i *)(data + i)));
+    }
+    int lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, maximum);
+    result = *std::max_element(lanes, lanes + 8);
+    return i;
+}
+
+AVX2 static int countAvx2(const int *data, int n, int value, int & result) {
+    __m256i broadcast = _mm256_set1_epi32(value);
+    __m256i count = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i equal = _mm256_cmpeq_epi32(
+            _mm256_loadu_si256((const __m256i *)(data + i)), broadcast);
+        count = _mm256_sub_epi32(count, equal);
+    }
+    int lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, count);
+    for (int k = 0; k < 8; k++) {
+        result += lanes[k];
+    }
+    return i;
+}
+#endif
+
+void fillArray(int *data, int n, int value) {
+    int i = 0;
+#ifdef VECTORIZED
+    if (hasAvx2()) {
+        i = fillAvx2(data, n, value);
+    }
+#endif
+    for (; i < n; i++) {
+        data[i] = value;
+    }
+}
+
+void combineArrays(OPERATOR type, int *data, const int *other, int n) {
+    int i = 0;
+#ifdef VECTORIZED
+    if (hasAvx2()) {
+        i = combineArraysAvx2(type, data, other, n);
+    }
+#endif
+    switch (type) {
+        SCALAR_CASES(other[i])
+        default:
+            break;
+    }
+}
+
+void combineValue(OPERATOR type, int *data, int value, int n) {
+    int i = 0;
+#ifdef VECTORIZED
+    if (hasAvx2()) {
+        i = combineValueAvx2(type, data, value, n);
+    }
+#endif
+    switch (type) {
+        SCALAR_CASES(value)
+        default:
+            break;
+    }
+}
+
+int sumArray(const int *data, int n) {
+    int result = 0;
+    int i = 0;
+#ifdef VECTORIZED
+    if (hasAvx2()) {
+        i = sumAvx2(data, n, result);
+    }
+#endif
+    for (; i < n; i++) {
+        result = (int)((unsigned)result + (unsigned)data[i]);
+    }
+    return result;
+}
+
+int minArray(const int *data, int n) {
+    int result = data[0];
+    int i = 0;
+#ifdef VECTORIZED
+    if (hasAvx2()) {
+        i = minAvx2(data, n, result);
+    }
+#endif
+    for (; i < n; i++) {
+        result = std::min(result, data[i]);
+    }
+    return result;
+}
+
+int maxArray(const int *data, int n) {
+    int result = data[0];
+    int i = 0;
+#ifdef VECTORIZED
+    if (hasAvx2()) {
+        i = maxAvx2(data, n, result);
+    }
+#endif
+    for (; i < n; i++) {
+        result = std::max(result, data[i]);
+    }
+    return result;
+}
+
+int countEqual(const int *data, int n, int value) {
+    int result = 0;
+    int i = 0;
+#ifdef VECTORIZED
+    if (hasAvx2()) {
+        i = countAvx2(data, n, value, result);
+    }
+#endif
+    for (; i < n; i++) {
+        result += data[i] == value;
+    }
+    return result;
+}
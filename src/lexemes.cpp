@@ -1,3 +1,7 @@
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
 #include "lexemes.h"
 
 using std::cout;
@@ -6,72 +10,84 @@ using std::cerr;
 
 #define UNDEFINED -1
 
-Lexem::Lexem() {
+Arena::Arena() {
+    current = -1;
+    used = CHUNK_SIZE;
 }
 
-Lexem::~Lexem() {
+Arena::~Arena() {
+    for (int i = 0; i < (int)chunks.size(); i++) {
+        delete[] chunks[i];
+    }
 }
 
-Number::Number(int value) {
-    Number::value = value;
+void *Arena::allocate(size_t size) {
+    size_t align = alignof(std::max_align_t);
+    size = (size + align - 1) / align * align;
+    if (size > CHUNK_SIZE) {
+        throw std::bad_alloc();
+    }
+    if (used + size > CHUNK_SIZE) {
+        current++;
+        if (current == (int)chunks.size()) {
+            chunks.push_back(new char[CHUNK_SIZE]);
+        }
+        used = 0;
+    }
+    void *pointer = chunks[current] + used;
+    used += size;
+    return pointer;
 }
 
-int Number::getValue() const {
-    return value;
+void Arena::release() {
+    current = -1;
+    used = CHUNK_SIZE;
 }
 
-Variable::Variable(string name) {
-    Variable::name = name;
+void *operator new(size_t size, Arena & arena) {
+    return arena.allocate(size);
 }
 
-string Variable::getName() const {
-    return name;
+void operator delete(void *, Arena &) {
 }
 
-int Variable::getValue() const {
-    return VarTable[name];
+Lexem::Lexem() {
 }
 
-void Variable::setValue(int value) const {
-    VarTable[name] = value;
+bool Lexem::isOperator() const {
+    return false;
 }
 
-ArrayElem::ArrayElem(string name, int index) {
-    ArrayElem::name = name;
-    ArrayElem::index = index;
+Number::Number(int value) {
+    Number::value = value;
 }
 
-int ArrayElem::getValue() const {
-    if ((int)ArrayTable[name].size() < index + 1) {
-        ArrayTable[name].resize(index + 1);
-    }
-    return ArrayTable[name][index];
+int Number::getValue() const {
+    return value;
 }
 
-void ArrayElem::setValue(int value) const {
-    if ((int)ArrayTable[name].size() < index + 1) {
-        ArrayTable[name].resize(index + 1);
-    }
-    ArrayTable[name][index] = value;
+Variable::Variable(int slot) {
+    Variable::slot = slot;
+}
+
+int Variable::getSlot() const {
+    return slot;
 }
 
 Oper::Oper(OPERATOR opertype) {
     Oper::opertype = opertype;
 }
 
+bool Oper::isOperator() const {
+    return true;
+}
+
 OPERATOR Oper::getType() const {
     return opertype;
 }
 
 int Oper::getPriority() const {
-    int priority;
-    int n = (int)sizeof(OPERATOR_STRING) / sizeof(string);
-    for (int i = 0; i < n; i++) {
-        if (opertype == OPERATOR(i)) {
-            priority = PRIORITY[i];
-        }
-    }
-    return priority;
+    return PRIORITY[opertype];
 }
 
 Binary::Binary(OPERATOR opertype) : Oper(opertype) {
@@ -106,11 +122,11 @@ int Binary::getValue(int left, int right) const {
         case GT:
             return left > right;
         case PLUS:
-            return left + right;
+            return (int)((unsigned)left + (unsigned)right);
         case MINUS:
-            return left - right;
+            return (int)((unsigned)left - (unsigned)right);
         case MULT:
-            return left * right;
+            return (int)((unsigned)left * (unsigned)right);
         case DIV:
             return left / right;
         case MOD:
@@ -125,26 +141,6 @@ int Binary::getValue(int left, int right) const {
 Assign::Assign() : Oper(ASSIGN) {
 }
 
-int Assign::getValue(const Variable & left, int right) const {
-    if (getType() == ASSIGN) {
-        left.setValue(right);
-        return right;
-    } else {
-        cerr << "Error: invalid operation" << endl;
-        return -1;
-    }
-}
-
-int Assign::getValue(const ArrayElem & left, int right) const {
-    if (getType() == ASSIGN) {
-        left.setValue(right);
-        return right;
-    } else {
-        cerr << "Error: invalid operation" << endl;
-        return -1;
-    }
-}
-
 Goto::Goto(OPERATOR opertype) : Oper(opertype) {
     row = UNDEFINED;
 }
@@ -157,23 +153,35 @@ int Goto::getRow() {
     return row;
 }
 
-int Goto::getValue(const Variable & var) const {
-    if (getType() == GOTO) {
-        return LabelTable[var.getName()];
-    } else {
-        cerr << "Error: invalid operation" << endl;
-        return -1;
-    }
+Dereference::Dereference() : Oper(DEREF) {
 }
 
-Dereference::Dereference() : Oper(DEREF) {
+int getArity(BUILTIN builtin) {
+    return (int)strlen(BUILTIN_PARAMETERS[builtin]);
+}
+
+Call::Call(BUILTIN builtin) : Oper(CALL) {
+    Call::builtin = builtin;
+    arguments = 1;
+}
+
+BUILTIN Call::getBuiltin() const {
+    return builtin;
+}
+
+void Call::addArgument() {
+    arguments++;
 }
 
-ArrayElem *Dereference::getValue(string name, int index) const {
-    ArrayElem *elem = new ArrayElem(name, index);
-    return elem;
+bool Call::isComplete() const {
+    return arguments == getArity(builtin);
 }
 
-map<string, int> Variable::VarTable;
-map<string, vector<int>> ArrayElem::ArrayTable;
-map<string, int> Goto::LabelTable;
+static_assert(std::is_trivially_destructible<Number>::value &&
+              std::is_trivially_destructible<Variable>::value &&
+              std::is_trivially_destructible<Binary>::value &&
+              std::is_trivially_destructible<Assign>::value &&
+              std::is_trivially_destructible<Goto>::value &&
+              std::is_trivially_destructible<Dereference>::value &&
+              std::is_trivially_destructible<Call>::value,
+              "parser lexemes are released with their arena");
@@ -0,0 +1,326 @@
+#include <climits>
+#include <set>
+#include "lexemes.h"
+#include "program.h"
+#include "cfg.h"
+#include "ssa.h"
+#include "optimizer.h"
+
+using std::set;
+
+static bool isBinary(OPCODE opcode) {
+    return opcode >= OP_OR && opcode <= OP_MOD;
+}
+
+static bool isJump(OPCODE opcode) {
+    return opcode == OP_JUMP || opcode == OP_JUMP_FALSE;
+}
+
+static bool isCompare(OPCODE opcode) {
+    return opcode == OP_EQ || opcode == OP_NEQ || opcode == OP_LEQ ||
+           opcode == OP_LT || opcode == OP_GEQ || opcode == OP_GT;
+}
+
+static OPCODE getBranch(OPCODE opcode) {
+    switch (opcode) {
+        case OP_EQ:
+            return OP_BRANCH_EQ;
+        case OP_NEQ:
+            return OP_BRANCH_NEQ;
+        case OP_LEQ:
+            return OP_BRANCH_LEQ;
+        case OP_LT:
+            return OP_BRANCH_LT;
+        case OP_GEQ:
+            return OP_BRANCH_GEQ;
+        default:
+            return OP_BRANCH_GT;
+    }
+}
+
+static int getPowerOfTwo(int value) {
+    if (value <= 1 || (value & (value - 1)) != 0) {
+        return UNDEFINED;
+    }
+    int power = 0;
+    while (value > 1) {
+        value >>= 1;
+        power++;
+    }
+    return power;
+}
+
+Optimizer::Optimizer(Program & program) : program(program) {
+}
+
+void Optimizer::split() {
+    rows.assign(program.size(), vector<Instruction>());
+    for (int row = 0; row < program.size(); row++) {
+        rows[row].assign(program.code.begin() + program.rowOffset[row],
+                         program.code.begin() + program.rowOffset[row + 1]);
+    }
+}
+
+void Optimizer::join(const vector<int> & newRow) {
+    vector<int> lines;
+    program.code.clear();
+    program.rowOffset.clear();
+    for (int row = 0; row < (int)rows.size(); row++) {
+        if (newRow[row] == newRow[row + 1]) {
+            continue;
+        }
+        lines.push_back(program.lines[row]);
+        program.rowOffset.push_back((int)program.code.size());
+        for (int i = 0; i < (int)rows[row].size(); i++) {
+            Instruction instruction = rows[row][i];
+            if (isJump(instruction.opcode)) {
+                instruction.operand = newRow[instruction.operand];
+            } else if (instruction.opcode >= OP_BRANCH_EQ &&
+                       instruction.opcode <= OP_BRANCH_GT) {
+                instruction.argument = newRow[instruction.argument];
+            }
+            program.code.push_back(instruction);
+        }
+    }
+    program.rowOffset.push_back((int)program.code.size());
+    program.lines = lines;
+    program.emit(OP_HALT);
+    for (int i = 0; i < (int)program.labels.size(); i++) {
+        if (program.labels[i] != UNDEFINED) {
+            program.labels[i] = newRow[program.labels[i]];
+        }
+    }
+}
+
+vector<int> Optimizer::getSuccessors(int row) const {
+    vector<int> successors;
+    const Instruction & last = rows[row].back();
+    if (last.opcode == OP_END || last.opcode == OP_JUMP_FALSE) {
+        successors.push_back(row + 1);
+    }
+    if (isJump(last.opcode)) {
+        successors.push_back(last.operand);
+    }
+    if (last.opcode == OP_GOTO && program.labels[last.operand] != UNDEFINED) {
+        successors.push_back(program.labels[last.operand]);
+    }
+    return successors;
+}
+
+bool Optimizer::fold(vector<Instruction> & code) {
+    int n = (int)code.size();
+    if (n < 3 || isBinary(code[n - 1].opcode) == false ||
+        code[n - 2].opcode != OP_PUSH_NUM ||
+        code[n - 3].opcode != OP_PUSH_NUM) {
+        return false;
+    }
+    OPCODE opcode = code[n - 1].opcode;
+    int left = code[n - 3].operand;
+    int right = code[n - 2].operand;
+    if ((opcode == OP_DIV || opcode == OP_MOD) &&
+        (right == 0 || (left == INT_MIN && right == -1))) {
+        return false;
+    }
+    if ((opcode == OP_SHL || opcode == OP_SHR) && (right < 0 || right > 31)) {
+        return false;
+    }
+    Binary binary(OPERATOR(opcode - OP_OR + OR));
+    code.resize(n - 2);
+    code.back().operand = binary.getValue(left, right);
+    return true;
+}
+
+bool Optimizer::reduce(vector<Instruction> & code) {
+    int n = (int)code.size();
+    if (n < 2 || isBinary(code[n - 1].opcode) == false ||
+        code[n - 2].opcode != OP_PUSH_NUM) {
+        return false;
+    }
+    OPCODE opcode = code[n - 1].opcode;
+    int right = code[n - 2].operand;
+    int power = getPowerOfTwo(right);
+    if ((right == 0 && (opcode == OP_PLUS || opcode == OP_MINUS ||
+                        opcode == OP_BITOR || opcode == OP_XOR ||
+                        opcode == OP_SHL || opcode == OP_SHR)) ||
+        (right == 1 && (opcode == OP_MULT || opcode == OP_DIV))) {
+        code.resize(n - 2);
+    } else if (right == 1 && opcode == OP_MOD) {
+        code.resize(n - 1);
+        code.back() = {OP_MOD_POW2, 0, 0};
+    } else if (power != UNDEFINED && opcode == OP_MULT) {
+        code.resize(n - 1);
+        code.back() = {OP_MULT_POW2, power, 0};
+    } else if (power != UNDEFINED && opcode == OP_DIV) {
+        code.resize(n - 1);
+        code.back() = {OP_DIV_POW2, power, 0};
+    } else if (power != UNDEFINED && opcode == OP_MOD) {
+        code.resize(n - 1);
+        code.back() = {OP_MOD_POW2, power, 0};
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void Optimizer::simplify(vector<Instruction> & row) {
+    vector<Instruction> code;
+    for (int i = 0; i < (int)row.size(); i++) {
+        code.push_back(row[i]);
+        while (fold(code) || reduce(code)) {
+        }
+    }
+    int n = (int)code.size();
+    if (n >= 3 && code[n - 1].opcode == OP_JUMP_FALSE &&
+        code[n - 2].opcode == OP_PRINT && code[n - 3].opcode == OP_PUSH_NUM) {
+        if (code[n - 3].operand == 0) {
+            code[n - 1].opcode = OP_JUMP;
+        } else {
+            code[n - 1] = {OP_END, 0, 0};
+        }
+    }
+    row = code;
+}
+
+bool Optimizer::fuseUpdate(vector<Instruction> & code) {
+    int n = (int)code.size();
+    if (n < 3 || code[n - 1].opcode != OP_STORE) {
+        return false;
+    }
+    int slot = code[n - 1].operand;
+    if (code[n - 2].opcode == OP_MULT_POW2 && code[n - 3].opcode == OP_LOAD &&
+        code[n - 3].operand == slot) {
+        int value = 1 << code[n - 2].operand;
+        code.resize(n - 2);
+        code.back() = {OP_UPDATE_MULT, slot, value};
+        return true;
+    }
+    OPCODE opcode = code[n - 2].opcode;
+    if (n < 4 || (opcode != OP_PLUS && opcode != OP_MINUS && opcode != OP_MULT)) {
+        return false;
+    }
+    int value;
+    if (code[n - 4].opcode == OP_LOAD && code[n - 4].operand == slot &&
+        code[n - 3].opcode == OP_PUSH_NUM) {
+        value = code[n - 3].operand;
+    } else if (code[n - 4].opcode == OP_PUSH_NUM && code[n - 3].opcode == OP_LOAD &&
+               code[n - 3].operand == slot && opcode != OP_MINUS) {
+        value = code[n - 4].operand;
+    } else {
+        return false;
+    }
+    code.resize(n - 3);
+    if (opcode == OP_MULT) {
+        code.back() = {OP_UPDATE_MULT, slot, value};
+    } else {
+        code.back() = {OP_INC, slot, opcode == OP_MINUS ?
+                       (int)(0u - (unsigned)value) : value};
+    }
+    return true;
+}
+
+bool Optimizer::fuseBranch(vector<Instruction> & code) {
+    int n = (int)code.size();
+    if (n >= 3 && code[n - 1].opcode == OP_MOD &&
+        code[n - 2].opcode == OP_PUSH_NUM && code[n - 2].operand != 0 &&
+        code[n - 3].opcode == OP_LOAD) {
+        int value = code[n - 2].operand;
+        code.resize(n - 2);
+        code.back() = {OP_LOAD_MOD, code.back().operand, value};
+        return true;
+    }
+    if (n < 4 || code[n - 1].opcode != OP_JUMP_FALSE ||
+        code[n - 2].opcode != OP_PRINT || isCompare(code[n - 3].opcode) == false ||
+        code[n - 4].opcode != OP_PUSH_NUM) {
+        return false;
+    }
+    int target = code[n - 1].operand;
+    OPCODE opcode = getBranch(code[n - 3].opcode);
+    code.resize(n - 3);
+    code.back() = {opcode, code.back().operand, target};
+    return true;
+}
+
+/* Rewrites the most frequent statement shapes into single instructions:
+ * x := x + c, x := x * c, x % c and a comparison against a constant that
+ * ends an IF/WHILE row. The fused forms still print and mark variables. */
+void Optimizer::fuse(vector<Instruction> & row) {
+    vector<Instruction> code;
+    for (int i = 0; i < (int)row.size(); i++) {
+        code.push_back(row[i]);
+        while (fuseUpdate(code) || fuseBranch(code)) {
+        }
+    }
+    row = code;
+}
+
+void Optimizer::findReachable() {
+    vector<int> queue;
+    reachable.assign(rows.size(), false);
+    if (rows.empty() == false) {
+        reachable[0] = true;
+        queue.push_back(0);
+    }
+    while (queue.empty() == false) {
+        vector<int> successors = getSuccessors(queue.back());
+        queue.pop_back();
+        for (int i = 0; i < (int)successors.size(); i++) {
+            int next = successors[i];
+            if (next < (int)rows.size() && reachable[next] == false) {
+                reachable[next] = true;
+                queue.push_back(next);
+            }
+        }
+    }
+}
+
+void Optimizer::removeDeadStores() {
+    set<int> dead;
+    for (int row = (int)rows.size() - 1; row >= 0; row--) {
+        vector<Instruction> & code = rows[row];
+        if (code.back().opcode != OP_END || row == (int)rows.size() - 1) {
+            dead.clear();
+        }
+        for (int i = (int)code.size() - 1; i >= 0; i--) {
+            if (code[i].opcode == OP_STORE && dead.count(code[i].operand)) {
+                code.erase(code.begin() + i);
+            } else if (code[i].opcode == OP_STORE) {
+                dead.insert(code[i].operand);
+            } else if (code[i].opcode == OP_LOAD ||
+                       code[i].opcode == OP_LOAD_UNDER) {
+                dead.erase(code[i].operand);
+            }
+        }
+    }
+}
+
+vector<int> Optimizer::renumber(bool removeEmpty) const {
+    vector<int> newRow(rows.size() + 1);
+    int count = 0;
+    for (int row = 0; row < (int)rows.size(); row++) {
+        newRow[row] = count;
+        bool empty = rows[row].size() == 1 && rows[row][0].opcode == OP_END;
+        if (reachable[row] && (removeEmpty == false || empty == false)) {
+            count++;
+        }
+    }
+    newRow[rows.size()] = count;
+    return newRow;
+}
+
+void Optimizer::optimize(bool observable) {
+    if (observable == false) {
+        Ssa(program).optimize();
+    }
+    split();
+    for (int row = 0; row < (int)rows.size(); row++) {
+        simplify(rows[row]);
+    }
+    findReachable();
+    if (observable == false) {
+        removeDeadStores();
+    }
+    for (int row = 0; row < (int)rows.size(); row++) {
+        fuse(rows[row]);
+    }
+    join(renumber(observable == false));
+}
@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include "lexemes.h"
+#include "tokenizer.h"
+#include "program.h"
+#include "profiler.h"
+
+using std::endl;
+
+enum {
+    REPORT_LINES = 20
+};
+
+/* Counts, cycles and jump outcomes are collected per row by
+ * Interpreter::runCounted; program.lines maps rows back to source lines,
+ * which the optimizer keeps up to date when it drops rows. */
+Profiler::Profiler(const Program & program, const Interpreter & interpreter,
+                   const vector<string_view> & source) :
+    program(program), interpreter(interpreter), source(source) {
+    total = 0;
+    for (int row = 0; row < program.size(); row++) {
+        total += interpreter.rowCycles[row];
+    }
+}
+
+bool Profiler::isConditional(int row) const {
+    OPCODE opcode = program.code[program.rowOffset[row + 1] - 1].opcode;
+    return opcode == OP_JUMP_FALSE ||
+           (opcode >= OP_BRANCH_EQ && opcode <= OP_BRANCH_GT);
+}
+
+/* A loop is a backward jump: the ENDWHILE of a WHILE or a GOTO to an
+ * earlier label. Its cost includes everything nested in it. */
+vector<Profiler::Loop> Profiler::getLoops() const {
+    vector<Loop> loops;
+    for (int row = 0; row < program.size(); row++) {
+        const Instruction & last = program.code[program.rowOffset[row + 1] - 1];
+        int target = UNDEFINED;
+        if (last.opcode == OP_JUMP) {
+            target = last.operand;
+        } else if (last.opcode == OP_GOTO) {
+            target = program.labels[last.operand];
+        }
+        if (target == UNDEFINED || target > row || interpreter.rowCounts[row] == 0) {
+            continue;
+        }
+        Loop loop = {target, row, interpreter.rowCounts[row], 0};
+        for (int i = target; i <= row; i++) {
+            loop.cycles += interpreter.rowCycles[i];
+        }
+        loops.push_back(loop);
+    }
+    std::sort(loops.begin(), loops.end(), [](const Loop & a, const Loop & b) {
+        return a.cycles > b.cycles;
+    });
+    return loops;
+}
+
+vector<long long> Profiler::getOperatorCounts() const {
+    vector<long long> counts(OP_HALT + 1);
+    for (int row = 0; row < program.size(); row++) {
+        for (int pc = program.rowOffset[row]; pc < program.rowOffset[row + 1]; pc++) {
+            counts[program.code[pc].opcode] += interpreter.rowCounts[row];
+        }
+    }
+    return counts;
+}
+
+static double getShare(unsigned long long cycles, unsigned long long total) {
+    return total == 0 ? 0.0 : 100.0 * cycles / total;
+}
+
+void Profiler::printReport(ostream & out) const {
+    vector<int> rows;
+    for (int row = 0; row < program.size(); row++) {
+        if (interpreter.rowCounts[row] > 0) {
+            rows.push_back(row);
+        }
+    }
+    std::sort(rows.begin(), rows.end(), [this](int a, int b) {
+        return interpreter.rowCycles[a] > interpreter.rowCycles[b];
+    });
+    if ((int)rows.size() > REPORT_LINES) {
+        rows.resize(REPORT_LINES);
+    }
+    out << "----------Profile--------" << '\n';
+    out << std::fixed << std::setprecision(1);
+    for (int i = 0; i < (int)rows.size(); i++) {
+        int row = rows[i];
+        int line = program.lines[row];
+        out << "line " << line + 1 << ": " << interpreter.rowCounts[row] <<
+            " runs, " << interpreter.rowCycles[row] << " cycles (" <<
+            getShare(interpreter.rowCycles[row], total) << "%)";
+        if (isConditional(row)) {
+            out << ", " << interpreter.rowTaken[row] << " taken, " <<
+                interpreter.rowCounts[row] - interpreter.rowTaken[row] <<
+                " not taken";
+        }
+        if (line < (int)source.size()) {
+            out << " | " << source[line];
+        }
+        out << '\n';
+    }
+    out << "---------Hot loops-------" << '\n';
+    vector<Loop> loops = getLoops();
+    for (int i = 0; i < (int)loops.size() && i < REPORT_LINES; i++) {
+        out << "lines " << program.lines[loops[i].first] + 1 << "-" <<
+            program.lines[loops[i].last] + 1 << ": " << loops[i].iterations <<
+            " iterations, " << loops[i].cycles << " cycles (" <<
+            getShare(loops[i].cycles, total) << "%)" << '\n';
+    }
+    out << "---------Operators-------" << '\n';
+    vector<long long> counts = getOperatorCounts();
+    for (int i = 0; i <= OP_HALT; i++) {
+        if (counts[i] > 0) {
+            out << OPCODE_STRING[i] << ": " << counts[i] << '\n';
+        }
+    }
+    out << "-------------------------" << endl;
+    out << std::defaultfloat;
+}
+
+void Profiler::writeJson(ostream & out) const {
+    out << "{\n  \"cycles\": " << total << ",\n  \"lines\": [";
+    bool first = true;
+    for (int row = 0; row < program.size(); row++) {
+        if (interpreter.rowCounts[row] == 0) {
+            continue;
+        }
+        out << (first ? "\n" : ",\n") << "    {\"line\": " <<
+            program.lines[row] + 1 << ", \"count\": " <<
+            interpreter.rowCounts[row] << ", \"cycles\": " <<
+            interpreter.rowCycles[row];
+        if (isConditional(row)) {
+            out << ", \"taken\": " << interpreter.rowTaken[row] <<
+                ", \"not_taken\": " <<
+                interpreter.rowCounts[row] - interpreter.rowTaken[row];
+        }
+        out << "}";
+        first = false;
+    }
+    out << "\n  ],\n  \"loops\": [";
+    vector<Loop> loops = getLoops();
+    for (int i = 0; i < (int)loops.size(); i++) {
+        out << (i == 0 ? "\n" : ",\n") << "    {\"first\": " <<
+            program.lines[loops[i].first] + 1 << ", \"last\": " <<
+            program.lines[loops[i].last] + 1 << ", \"iterations\": " <<
+            loops[i].iterations << ", \"cycles\": " << loops[i].cycles << "}";
+    }
+    out << "\n  ],\n  \"operators\": {";
+    vector<long long> counts = getOperatorCounts();
+    first = true;
+    for (int i = 0; i <= OP_HALT; i++) {
+        if (counts[i] > 0) {
+            out << (first ? "\n" : ",\n") << "    \"" << OPCODE_STRING[i] <<
+                "\": " << counts[i];
+            first = false;
+        }
+    }
+    out << "\n  }\n}\n";
+}
+
+void Profiler::writeCsv(ostream & out) const {
+    out << "kind,name,count,cycles,taken,not_taken\n";
+    for (int row = 0; row < program.size(); row++) {
+        if (interpreter.rowCounts[row] == 0) {
+            continue;
+        }
+        out << "line," << program.lines[row] + 1 << "," <<
+            interpreter.rowCounts[row] << "," << interpreter.rowCycles[row] << ",";
+        if (isConditional(row)) {
+            out << interpreter.rowTaken[row] << "," <<
+                interpreter.rowCounts[row] - interpreter.rowTaken[row];
+        } else {
+            out << ",";
+        }
+        out << '\n';
+    }
+    vector<Loop> loops = getLoops();
+    for (int i = 0; i < (int)loops.size(); i++) {
+        out << "loop," << program.lines[loops[i].first] + 1 << "-" <<
+            program.lines[loops[i].last] + 1 << "," << loops[i].iterations <<
+            "," << loops[i].cycles << ",,\n";
+    }
+    vector<long long> counts = getOperatorCounts();
+    for (int i = 0; i <= OP_HALT; i++) {
+        if (counts[i] > 0) {
+            out << "operator," << OPCODE_STRING[i] << "," << counts[i] << ",,,\n";
+        }
+    }
+}
+
+bool Profiler::write(const string & path) const {
+    std::ofstream out(path);
+    if (out.is_open() == false) {
+        return false;
+    }
+    if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0) {
+        writeCsv(out);
+    } else {
+        writeJson(out);
+    }
+    return out.good();
+}
@@ -0,0 +1,922 @@
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include "lexemes.h"
+#include "program.h"
+#include "kernels.h"
+#include "trace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using std::endl;
+
+const char *OPCODE_STRING[] = {
+    "push_num",
+    "load", "load_under",
+    "load_elem", "load_elem_under",
+    "or",
+    "and",
+    "bitor",
+    "xor",
+    "bitand",
+    "eq",
+    "neq",
+    "leq", "shl",
+    "lt",
+    "geq", "shr",
+    "gt",
+    "plus", "minus",
+    "mult", "div", "mod",
+    "mult_pow2", "div_pow2", "mod_pow2",
+    "store", "store_elem", "call",
+    "inc", "update_mult", "load_mod",
+    "print",
+    "end", "jump", "jump_false", "goto",
+    "branch_eq",
+    "branch_neq",
+    "branch_leq",
+    "branch_lt",
+    "branch_geq",
+    "branch_gt",
+    "halt"
+};
+
+static_assert(sizeof(OPCODE_STRING) / sizeof(OPCODE_STRING[0]) == OP_HALT + 1,
+              "every opcode needs a name");
+
+Program::Program() {
+    stackSize = 0;
+}
+
+int Program::emit(OPCODE opcode, int operand /*= 0*/,
+                  int argument /*= 0*/) {
+    code.push_back({opcode, operand, argument});
+    return (int)code.size() - 1;
+}
+
+/* Variables and array elements are read when an operator consumes them,
+ * not when they are pushed. A left operand is therefore loaded eagerly
+ * unless an assignment was emitted after it, in which case its cell is
+ * reserved and filled in by OP_LOAD_UNDER / OP_LOAD_ELEM_UNDER. A goto
+ * to a known label becomes a plain OP_JUMP; OP_GOTO is left only for a
+ * label that is undefined so far, which the REPL may still define. */
+bool Program::compileRow(const vector<Lexem *> & polizline) {
+    vector<Operand> operands;
+    Goto *terminator = nullptr;
+    int assigns = 0;
+    for (int i = 0; i < (int)polizline.size(); i++) {
+        if (polizline[i] == nullptr) {
+            continue;
+        }
+        Number *number = dynamic_cast<Number *>(polizline[i]);
+        Variable *variable = dynamic_cast<Variable *>(polizline[i]);
+        Oper *oper = polizline[i]->isOperator() ?
+            static_cast<Oper *>(polizline[i]) : nullptr;
+        if (number != nullptr) {
+            int offset = emit(OP_PUSH_NUM, number->getValue());
+            operands.push_back({Operand::VALUE, 0, offset, assigns});
+        } else if (variable != nullptr) {
+            int offset = emit(OP_LOAD, variable->getSlot());
+            operands.push_back({Operand::VARIABLE, variable->getSlot(),
+                                offset, assigns});
+        } else if (dynamic_cast<Goto *>(oper) != nullptr) {
+            terminator = dynamic_cast<Goto *>(oper);
+        } else if (oper->getType() == CALL) {
+            BUILTIN builtin = static_cast<Call *>(oper)->getBuiltin();
+            int arity = getArity(builtin);
+            int first = (int)operands.size() - arity;
+            if (first < 0) {
+                return false;
+            }
+            for (int k = 0; k < arity; k++) {
+                if (BUILTIN_PARAMETERS[builtin][k] != 'a') {
+                    continue;
+                }
+                if (operands[first + k].kind != Operand::VARIABLE) {
+                    return false;
+                }
+                code[operands[first + k].offset] = {OP_PUSH_NUM,
+                                                    operands[first + k].slot, 0};
+            }
+            operands.resize(first);
+            emit(OP_CALL, builtin, arity);
+            operands.push_back({Operand::VALUE, 0, 0, assigns});
+        } else {
+            if (operands.size() < 2) {
+                return false;
+            }
+            Operand left = operands[operands.size() - 2];
+            operands.pop_back();
+            operands.pop_back();
+            if (oper->getType() == ASSIGN) {
+                if (left.kind == Operand::VALUE) {
+                    return false;
+                }
+                code.erase(code.begin() + left.offset);
+                if (left.kind == Operand::VARIABLE) {
+                    emit(OP_STORE, left.slot);
+                } else {
+                    emit(OP_STORE_ELEM, left.slot);
+                }
+                assigns++;
+                operands.push_back({Operand::VALUE, 0, 0, assigns});
+            } else if (oper->getType() == DEREF) {
+                if (left.kind != Operand::VARIABLE) {
+                    return false;
+                }
+                code.erase(code.begin() + left.offset);
+                int offset = emit(OP_LOAD_ELEM, left.slot);
+                operands.push_back({Operand::ELEMENT, left.slot,
+                                    offset, assigns});
+            } else {
+                if (left.assigns != assigns &&
+                    left.kind == Operand::VARIABLE) {
+                    code[left.offset] = {OP_PUSH_NUM, 0, 0};
+                    emit(OP_LOAD_UNDER, left.slot);
+                } else if (left.assigns != assigns &&
+                           left.kind == Operand::ELEMENT) {
+                    code.erase(code.begin() + left.offset);
+                    emit(OP_LOAD_ELEM_UNDER, left.slot);
+                }
+                emit(OPCODE(OP_OR + oper->getType() - OR));
+                operands.push_back({Operand::VALUE, 0, 0, assigns});
+            }
+        }
+        if ((int)operands.size() > stackSize) {
+            stackSize = (int)operands.size();
+        }
+    }
+    bool label = operands.empty() == false &&
+                 operands.back().kind == Operand::VARIABLE;
+    if (label && (terminator == nullptr || terminator->getType() == GOTO)) {
+        code.erase(code.begin() + operands.back().offset);
+    } else if (operands.empty() == false && label == false) {
+        emit(OP_PRINT);
+    }
+    if (terminator == nullptr) {
+        emit(OP_END);
+    } else if (terminator->getType() == IF || terminator->getType() == WHILE) {
+        emit(OP_JUMP_FALSE, terminator->getRow());
+    } else if (terminator->getType() == GOTO) {
+        if (label == false) {
+            return false;
+        }
+        int slot = operands.back().slot;
+        if (labels[slot] == UNDEFINED) {
+            emit(OP_GOTO, slot);
+        } else {
+            emit(OP_JUMP, labels[slot]);
+        }
+    } else {
+        emit(OP_JUMP, terminator->getRow());
+    }
+    return true;
+}
+
+bool Program::compile(const vector<vector<Lexem *>> & poliz,
+                      const vector<string> & symbols,
+                      const map<string, int> & labels,
+                      ostream & err /*= std::cerr*/) {
+    if (append(poliz, symbols, labels, err) == false) {
+        return false;
+    }
+    /* Only the REPL can define a label after the goto that names it. */
+    bool defined = true;
+    for (int row = 0; row < size(); row++) {
+        const Instruction & terminator = code[rowOffset[row + 1] - 1];
+        if (terminator.opcode == OP_GOTO) {
+            err << "Error: undefined label " << Program::symbols[terminator.operand] <<
+                " at line " << lines[row] + 1 << endl;
+            defined = false;
+        }
+    }
+    return defined;
+}
+
+/* The new rows take the place of the final OP_HALT. If one of them does
+ * not compile, the program is left as it was. */
+bool Program::append(const vector<vector<Lexem *>> & poliz,
+                     const vector<string> & symbols,
+                     const map<string, int> & labels,
+                     ostream & err /*= std::cerr*/) {
+    if (rowOffset.empty() == false) {
+        rowOffset.pop_back();
+        code.pop_back();
+    }
+    int first = (int)rowOffset.size();
+    int start = (int)code.size();
+    Program::symbols.insert(Program::symbols.end(),
+                            symbols.begin() + Program::symbols.size(),
+                            symbols.end());
+    Program::labels.resize(symbols.size(), UNDEFINED);
+    for (int i = 0; i < (int)symbols.size(); i++) {
+        map<string, int>::const_iterator it = labels.find(symbols[i]);
+        Program::labels[i] = it == labels.end() ? UNDEFINED : it->second;
+    }
+    bool compiled = true;
+    for (int row = first; row < first + (int)poliz.size() && compiled; row++) {
+        rowOffset.push_back((int)code.size());
+        lines.push_back(row);
+        if (compileRow(poliz[row - first]) == false) {
+            err << '\n' <<"#######" << '\n' <<
+                "Syntax error: line " << row + 1 << endl;
+            compiled = false;
+        }
+    }
+    if (compiled == false) {
+        code.resize(start);
+        rowOffset.resize(first);
+        lines.resize(first);
+    }
+    rowOffset.push_back((int)code.size());
+    emit(OP_HALT);
+    return compiled;
+}
+
+int Program::size() const {
+    return (int)rowOffset.size() - 1;
+}
+
+/* An array starts dense and exists once any element has been touched. A
+ * negative index, or one that would more than double a large array,
+ * moves it to fixed-size pages that are allocated on first write; reads
+ * of missing pages return 0. */
+Array::Array() {
+    used = false;
+    paged = false;
+}
+
+bool Array::isUsed() const {
+    return used;
+}
+
+bool Array::isDense(int index) {
+    if (paged || (index >= 0 && (index < DENSE_LIMIT ||
+                                 index < 2 * (long long)values.size()))) {
+        return paged == false;
+    }
+    paged = true;
+    for (int i = 0; i < (int)values.size(); i++) {
+        if (values[i] != 0) {
+            store(i, values[i]);
+        }
+    }
+    vector<int>().swap(values);
+    return false;
+}
+
+void Array::grow(int index) {
+    if ((int)values.size() < index + 1) {
+        if ((int)values.capacity() < index + 1) {
+            values.reserve(std::max((size_t)index + 1, 2 * values.capacity()));
+        }
+        values.resize(index + 1);
+    }
+}
+
+int *Array::getRange(int from, int to) {
+    used = true;
+    if (isDense(from) == false || isDense(to - 1) == false) {
+        return nullptr;
+    }
+    grow(to - 1);
+    return values.data() + from;
+}
+
+int Array::load(int index) {
+    used = true;
+    if (isDense(index)) {
+        grow(index);
+        return values[index];
+    }
+    unordered_map<int, vector<int>>::const_iterator it = pages.find(index >> PAGE_BITS);
+    return it == pages.end() ? 0 : it->second[index & (PAGE_SIZE - 1)];
+}
+
+void Array::store(int index, int value) {
+    used = true;
+    if (isDense(index)) {
+        grow(index);
+        values[index] = value;
+        return;
+    }
+    vector<int> & page = pages[index >> PAGE_BITS];
+    if (page.empty()) {
+        page.resize(PAGE_SIZE);
+    }
+    page[index & (PAGE_SIZE - 1)] = value;
+}
+
+void Array::print(ostream & out) const {
+    if (paged == false) {
+        for (int i = 0; i < (int)values.size(); i++) {
+            out << "[" << values[i] << "] ";
+        }
+        return;
+    }
+    vector<int> numbers;
+    unordered_map<int, vector<int>>::const_iterator it;
+    for (it = pages.begin(); it != pages.end(); it++) {
+        numbers.push_back(it->first);
+    }
+    std::sort(numbers.begin(), numbers.end());
+    for (int i = 0; i < (int)numbers.size(); i++) {
+        const vector<int> & page = pages.at(numbers[i]);
+        for (int j = 0; j < PAGE_SIZE; j++) {
+            if (page[j] != 0) {
+                out << (long long)numbers[i] * PAGE_SIZE + j << ":[" << page[j] << "] ";
+            }
+        }
+    }
+}
+
+void Array::printMemory(ostream & out) const {
+    if (paged) {
+        out << "paged, " << pages.size() << " pages, " <<
+            pages.size() * PAGE_SIZE * sizeof(int) << " bytes";
+    } else {
+        out << "dense, " << values.size() << " elements, " <<
+            values.capacity() * sizeof(int) << " bytes";
+    }
+}
+
+Interpreter::Interpreter(const Program & program,
+                         ostream & out /*= std::cout*/,
+                         ostream & err /*= std::cerr*/) :
+    program(program), out(out), err(err) {
+    row = 0;
+    stack.resize(program.stackSize);
+    variables.resize(program.symbols.size());
+    defined.resize(program.symbols.size());
+    dirty.resize(program.symbols.size());
+    arrays.resize(program.symbols.size());
+    arrayDirty.resize(program.symbols.size());
+    trace = nullptr;
+    failed = false;
+}
+
+bool Interpreter::isFinished() const {
+    return row >= program.size();
+}
+
+bool Interpreter::hasFailed() const {
+    return failed;
+}
+
+static inline int divPow2(int value, int shift) {
+    return (value + ((value >> 31) & ((1 << shift) - 1))) >> shift;
+}
+
+/* INT_MIN / -1 wraps around like the other arithmetic instead of trapping;
+ * the divisor is known not to be zero. */
+static inline int divide(int left, int right) {
+    return right == -1 ? (int)(0u - (unsigned)left) : left / right;
+}
+
+static inline int modulo(int left, int right) {
+    return right == -1 ? 0 : left % right;
+}
+
+/* With computed goto every handler jumps straight to the next one through
+ * a per-instruction handler table, so each opcode gets its own indirect
+ * branch. The switch is only entered for the first instruction. Code
+ * appended to the program replaces its OP_HALT, so the table is extended
+ * from there. Build with -DSWITCH_DISPATCH for the portable loop. */
+#if defined(__GNUC__) && !defined(SWITCH_DISPATCH)
+#define THREADED_DISPATCH
+#endif
+
+#ifdef THREADED_DISPATCH
+#define TARGET(opcode) \
+            case opcode: \
+            L_##opcode:
+#define DISPATCH() \
+                instruction = &program.code[pc]; \
+                goto *threaded[pc++];
+#else
+#define TARGET(opcode) \
+            case opcode:
+#define DISPATCH() \
+                break;
+#endif
+
+#define BINARY_OPERATION(opcode, operation) \
+            TARGET(opcode) \
+                top--; \
+                top[-1] = top[-1] operation top[0]; \
+                DISPATCH()
+
+/* Addition, subtraction and multiplication wrap around instead of
+ * overflowing, like the fused updates. */
+#define WRAPPING_OPERATION(opcode, operation) \
+            TARGET(opcode) \
+                top--; \
+                top[-1] = (int)((unsigned)top[-1] operation (unsigned)top[0]); \
+                DISPATCH()
+
+/* Dividing by zero stops the program with an error instead of raising
+ * SIGFPE, which would kill every script sharing the process. */
+#define DIVISION_OPERATION(opcode, operation) \
+            TARGET(opcode) \
+                top--; \
+                if (top[0] == 0) { \
+                    err << "Error: division by zero at line " << \
+                        program.lines[row] + 1 << endl; \
+                    failed = true; \
+                    row = program.size(); \
+                    return; \
+                } \
+                top[-1] = operation(top[-1], top[0]); \
+                DISPATCH()
+
+#define NEXT_ROW(next) \
+                row = next; \
+                if (--budget == 0) { \
+                    return; \
+                } \
+                pc = program.rowOffset[row]; \
+                top = stack.data(); \
+                DISPATCH()
+
+#define TRACE_INSTRUCTION() \
+                tracer->record(pc - 1, top - stack.data() > 1 ? top[-2] : 0, \
+                               top > stack.data() ? top[-1] : 0);
+
+#define BRANCH_OPERATION(opcode, operation) \
+            TARGET(opcode) \
+                top[-1] = top[-1] operation instruction->operand; \
+                out << top[-1] << '\n'; \
+                NEXT_ROW(top[-1] == 0 ? instruction->argument : row + 1)
+
+void Interpreter::run(int steps) {
+    long long budget = steps > 0 ? steps : LLONG_MAX;
+    int *top = stack.data();
+    int pc = program.rowOffset[row];
+    const Instruction *instruction;
+    Trace *tracer = trace;
+#ifdef THREADED_DISPATCH
+    static const void *handlers[] = {
+        &&L_OP_PUSH_NUM,
+        &&L_OP_LOAD, &&L_OP_LOAD_UNDER,
+        &&L_OP_LOAD_ELEM, &&L_OP_LOAD_ELEM_UNDER,
+        &&L_OP_OR,
+        &&L_OP_AND,
+        &&L_OP_BITOR,
+        &&L_OP_XOR,
+        &&L_OP_BITAND,
+        &&L_OP_EQ,
+        &&L_OP_NEQ,
+        &&L_OP_LEQ, &&L_OP_SHL,
+        &&L_OP_LT,
+        &&L_OP_GEQ, &&L_OP_SHR,
+        &&L_OP_GT,
+        &&L_OP_PLUS, &&L_OP_MINUS,
+        &&L_OP_MULT, &&L_OP_DIV, &&L_OP_MOD,
+        &&L_OP_MULT_POW2, &&L_OP_DIV_POW2, &&L_OP_MOD_POW2,
+        &&L_OP_STORE, &&L_OP_STORE_ELEM, &&L_OP_CALL,
+        &&L_OP_INC, &&L_OP_UPDATE_MULT, &&L_OP_LOAD_MOD,
+        &&L_OP_PRINT,
+        &&L_OP_END, &&L_OP_JUMP, &&L_OP_JUMP_FALSE, &&L_OP_GOTO,
+        &&L_OP_BRANCH_EQ,
+        &&L_OP_BRANCH_NEQ,
+        &&L_OP_BRANCH_LEQ,
+        &&L_OP_BRANCH_LT,
+        &&L_OP_BRANCH_GEQ,
+        &&L_OP_BRANCH_GT,
+        &&L_OP_HALT
+    };
+    static_assert(sizeof(handlers) / sizeof(handlers[0]) == OP_HALT + 1,
+                  "every opcode needs a handler");
+    if (threaded.size() < program.code.size()) {
+        if (threaded.empty() == false) {
+            threaded.pop_back();
+        }
+        for (int i = (int)threaded.size(); i < (int)program.code.size(); i++) {
+            threaded.push_back(tracer != nullptr ? &&L_TRACE :
+                               handlers[program.code[i].opcode]);
+        }
+    }
+#endif
+    while (true) {
+        instruction = &program.code[pc++];
+        if (tracer != nullptr) {
+            TRACE_INSTRUCTION()
+        }
+        switch (instruction->opcode) {
+            TARGET(OP_PUSH_NUM)
+                *top++ = instruction->operand;
+                DISPATCH()
+            TARGET(OP_LOAD)
+                defined[instruction->operand] = true;
+                *top++ = variables[instruction->operand];
+                DISPATCH()
+            TARGET(OP_LOAD_UNDER)
+                defined[instruction->operand] = true;
+                top[-2] = variables[instruction->operand];
+                DISPATCH()
+            TARGET(OP_LOAD_ELEM)
+                top[-1] = arrays[instruction->operand].load(top[-1]);
+                DISPATCH()
+            TARGET(OP_LOAD_ELEM_UNDER)
+                top[-2] = arrays[instruction->operand].load(top[-2]);
+                DISPATCH()
+            BINARY_OPERATION(OP_OR, ||)
+            BINARY_OPERATION(OP_AND, &&)
+            BINARY_OPERATION(OP_BITOR, |)
+            BINARY_OPERATION(OP_XOR, ^)
+            BINARY_OPERATION(OP_BITAND, &)
+            BINARY_OPERATION(OP_EQ, ==)
+            BINARY_OPERATION(OP_NEQ, !=)
+            BINARY_OPERATION(OP_LEQ, <=)
+            BINARY_OPERATION(OP_SHL, <<)
+            BINARY_OPERATION(OP_LT, <)
+            BINARY_OPERATION(OP_GEQ, >=)
+            BINARY_OPERATION(OP_SHR, >>)
+            BINARY_OPERATION(OP_GT, >)
+            WRAPPING_OPERATION(OP_PLUS, +)
+            WRAPPING_OPERATION(OP_MINUS, -)
+            WRAPPING_OPERATION(OP_MULT, *)
+            DIVISION_OPERATION(OP_DIV, divide)
+            DIVISION_OPERATION(OP_MOD, modulo)
+            TARGET(OP_MULT_POW2)
+                top[-1] = (int)((unsigned)top[-1] << instruction->operand);
+                DISPATCH()
+            TARGET(OP_DIV_POW2)
+                top[-1] = divPow2(top[-1], instruction->operand);
+                DISPATCH()
+            TARGET(OP_MOD_POW2)
+                top[-1] = top[-1] - (int)((unsigned)divPow2(top[-1],
+                    instruction->operand) << instruction->operand);
+                DISPATCH()
+            TARGET(OP_STORE)
+                defined[instruction->operand] = true;
+                dirty[instruction->operand] = true;
+                variables[instruction->operand] = top[-1];
+                DISPATCH()
+            TARGET(OP_STORE_ELEM)
+                top--;
+                arrayDirty[instruction->operand] = true;
+                arrays[instruction->operand].store(top[-1], top[0]);
+                top[-1] = top[0];
+                DISPATCH()
+            TARGET(OP_CALL)
+                top -= instruction->argument;
+                *top = call(instruction->operand, top);
+                top++;
+                DISPATCH()
+            TARGET(OP_INC)
+                defined[instruction->operand] = true;
+                dirty[instruction->operand] = true;
+                variables[instruction->operand] = (int)(
+                    (unsigned)variables[instruction->operand] +
+                    (unsigned)instruction->argument);
+                *top++ = variables[instruction->operand];
+                DISPATCH()
+            TARGET(OP_UPDATE_MULT)
+                defined[instruction->operand] = true;
+                dirty[instruction->operand] = true;
+                variables[instruction->operand] = (int)(
+                    (unsigned)variables[instruction->operand] *
+                    (unsigned)instruction->argument);
+                *top++ = variables[instruction->operand];
+                DISPATCH()
+            TARGET(OP_LOAD_MOD)
+                defined[instruction->operand] = true;
+                *top++ = modulo(variables[instruction->operand], instruction->argument);
+                DISPATCH()
+            TARGET(OP_PRINT)
+                out << top[-1] << '\n';
+                DISPATCH()
+            TARGET(OP_END)
+                NEXT_ROW(row + 1)
+            TARGET(OP_JUMP)
+                NEXT_ROW(instruction->operand)
+            TARGET(OP_JUMP_FALSE)
+                NEXT_ROW(top[-1] == 0 ? instruction->operand : row + 1)
+            TARGET(OP_GOTO)
+                if (program.labels[instruction->operand] == UNDEFINED) {
+                    err << "Error: undefined label " <<
+                        program.symbols[instruction->operand] << endl;
+                    failed = true;
+                    row = program.size();
+                    return;
+                }
+                NEXT_ROW(program.labels[instruction->operand])
+            BRANCH_OPERATION(OP_BRANCH_EQ, ==)
+            BRANCH_OPERATION(OP_BRANCH_NEQ, !=)
+            BRANCH_OPERATION(OP_BRANCH_LEQ, <=)
+            BRANCH_OPERATION(OP_BRANCH_LT, <)
+            BRANCH_OPERATION(OP_BRANCH_GEQ, >=)
+            BRANCH_OPERATION(OP_BRANCH_GT, >)
+            TARGET(OP_HALT)
+                return;
+        }
+#ifdef THREADED_DISPATCH
+        /* While tracing, every entry of the handler table leads here. */
+        L_TRACE:
+            TRACE_INSTRUCTION()
+            goto *handlers[instruction->opcode];
+#endif
+    }
+}
+
+static const OPERATOR ELEMENTWISE[] = {
+    PLUS, MINUS, MULT, BITAND, BITOR, XOR
+};
+
+/* Array arguments arrive as slot numbers. Dense ranges go to the vector
+ * kernels; a range that is or becomes paged is processed element by
+ * element, with the same growth rules as single loads and stores. */
+int Interpreter::call(int builtin, const int *args) {
+    int arity = getArity(BUILTIN(builtin));
+    int from = args[arity - 2];
+    int to = args[arity - 1];
+    if (from >= to) {
+        return 0;
+    }
+    Array & target = arrays[args[0]];
+    int *data = target.getRange(from, to);
+    int n = (int)((unsigned)to - (unsigned)from);
+    if (builtin >= BUILTIN_SUM) {
+        if (data != nullptr) {
+            switch (builtin) {
+                case BUILTIN_SUM:
+                    return sumArray(data, n);
+                case BUILTIN_MIN:
+                    return minArray(data, n);
+                case BUILTIN_MAX:
+                    return maxArray(data, n);
+                default:
+                    return countEqual(data, n, args[1]);
+            }
+        }
+        int result = builtin == BUILTIN_MIN || builtin == BUILTIN_MAX ?
+                     target.load(from) : 0;
+        for (long long i = from; i < to; i++) {
+            int value = target.load((int)i);
+            if (builtin == BUILTIN_SUM) {
+                result = (int)((unsigned)result + (unsigned)value);
+            } else if (builtin == BUILTIN_MIN) {
+                result = std::min(result, value);
+            } else if (builtin == BUILTIN_MAX) {
+                result = std::max(result, value);
+            } else {
+                result += value == args[1];
+            }
+        }
+        return result;
+    }
+    arrayDirty[args[0]] = true;
+    if (builtin == BUILTIN_FILL) {
+        if (data != nullptr) {
+            fillArray(data, n, args[1]);
+        }
+        for (long long i = from; data == nullptr && i < to; i++) {
+            target.store((int)i, args[1]);
+        }
+        return n;
+    }
+    if (builtin >= BUILTIN_ADDS) {
+        OPERATOR type = ELEMENTWISE[builtin - BUILTIN_ADDS];
+        if (data != nullptr) {
+            combineValue(type, data, args[1], n);
+        }
+        for (long long i = from; data == nullptr && i < to; i++) {
+            target.store((int)i, combine(type, target.load((int)i), args[1]));
+        }
+        return n;
+    }
+    Array & source = arrays[args[1]];
+    const int *other = data != nullptr ? source.getRange(from, to) : nullptr;
+    if (other != nullptr && builtin == BUILTIN_COPY) {
+        memmove(data, other, n * sizeof(int));
+    } else if (other != nullptr) {
+        combineArrays(ELEMENTWISE[builtin - BUILTIN_ADD], data, other, n);
+    }
+    for (long long i = from; other == nullptr && i < to; i++) {
+        int value = source.load((int)i);
+        if (builtin != BUILTIN_COPY) {
+            value = combine(ELEMENTWISE[builtin - BUILTIN_ADD],
+                            target.load((int)i), value);
+        }
+        target.store((int)i, value);
+    }
+    return n;
+}
+
+static void printState(ostream & out, const map<string, int> & variables,
+                       const map<string, const Array *> & arrays) {
+    map<string, int>::const_iterator it;
+    map<string, const Array *>::const_iterator it2;
+    out << "--------Variables--------" << '\n';
+    for (it = variables.begin(); it != variables.end(); it++) {
+        out << it->first << " = " << it->second << '\n';
+    }
+    out << "-------------------------" << '\n';
+    out << "----------Arrays---------" << '\n';
+    for (it2 = arrays.begin(); it2 != arrays.end(); it2++) {
+        out << it2->first << ": ";
+        it2->second->print(out);
+        out << '\n';
+    }
+    out << "-------------------------" << '\n';
+}
+
+void Interpreter::printMap() const {
+    map<string, int> variables;
+    map<string, const Array *> arrays;
+    for (int i = 0; i < (int)Interpreter::variables.size(); i++) {
+        if (defined[i] && program.symbols[i][0] != '$') {
+            variables[program.symbols[i]] = Interpreter::variables[i];
+        }
+        if (Interpreter::arrays[i].isUsed()) {
+            arrays[program.symbols[i]] = &Interpreter::arrays[i];
+        }
+    }
+    printState(out, variables, arrays);
+}
+
+void Interpreter::printChanged() {
+    map<string, int> variables;
+    map<string, const Array *> arrays;
+    for (int i = 0; i < (int)program.symbols.size(); i++) {
+        if (dirty[i] && program.symbols[i][0] != '$') {
+            variables[program.symbols[i]] = Interpreter::variables[i];
+            dirty[i] = false;
+        }
+        if (arrayDirty[i]) {
+            arrays[program.symbols[i]] = &Interpreter::arrays[i];
+            arrayDirty[i] = false;
+        }
+    }
+    if (variables.empty() == false || arrays.empty() == false) {
+        printState(out, variables, arrays);
+    }
+}
+
+void Interpreter::printMemory() const {
+    map<string, const Array *> arrays;
+    map<string, const Array *>::const_iterator it;
+    for (int i = 0; i < (int)Interpreter::arrays.size(); i++) {
+        if (Interpreter::arrays[i].isUsed()) {
+            arrays[program.symbols[i]] = &Interpreter::arrays[i];
+        }
+    }
+    err << "----------Memory---------" << '\n';
+    for (it = arrays.begin(); it != arrays.end(); it++) {
+        err << it->first << ": ";
+        it->second->printMemory(err);
+        err << '\n';
+    }
+    err << "-------------------------" << endl;
+}
+
+static inline unsigned long long readCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+/* Rows are run one at a time so that each gets its count and cycles. A
+ * row ending in a conditional jump records whether the jump was taken. */
+void Interpreter::runCounted(int steps) {
+    long long budget = steps > 0 ? steps : LLONG_MAX;
+    while (budget-- > 0 && isFinished() == false) {
+        int current = row;
+        unsigned long long start = readCycles();
+        run(1);
+        rowCycles[current] += readCycles() - start;
+        rowCounts[current]++;
+        const Instruction & last = program.code[program.rowOffset[current + 1] - 1];
+        if ((last.opcode == OP_JUMP_FALSE && row == last.operand) ||
+            (last.opcode >= OP_BRANCH_EQ && last.opcode <= OP_BRANCH_GT &&
+             row == last.argument)) {
+            rowTaken[current]++;
+        }
+    }
+}
+
+/* Every instruction the interpreter runs is recorded in the trace, which
+ * is also written out when the program stops on an error. The JIT and
+ * the register VM do not record, so callers keep them off while tracing.
+ * The handler table is rebuilt to lead through the recording code. */
+void Interpreter::setTrace(Trace *trace) {
+    Interpreter::trace = trace;
+    threaded.clear();
+}
+
+void Interpreter::countRows() {
+    rowCounts.assign(program.size(), 0);
+    rowCycles.assign(program.size(), 0);
+    rowTaken.assign(program.size(), 0);
+}
+
+long long Interpreter::getExecutedRows() const {
+    long long total = 0;
+    for (int row = 0; row < (int)rowCounts.size(); row++) {
+        total += rowCounts[row];
+    }
+    return total;
+}
+
+void Interpreter::execute(DUMP mode, int steps) {
+    if (variables.size() < program.symbols.size()) {
+        variables.resize(program.symbols.size());
+        defined.resize(program.symbols.size());
+        dirty.resize(program.symbols.size());
+        arrays.resize(program.symbols.size());
+        arrayDirty.resize(program.symbols.size());
+    }
+    if ((int)stack.size() < program.stackSize) {
+        stack.resize(program.stackSize);
+    }
+    if (mode != DUMP_EVERY && mode != DUMP_CHANGED) {
+        steps = 0;
+    }
+    while (isFinished() == false) {
+        if (rowCounts.empty()) {
+            run(steps);
+        } else {
+            runCounted(steps);
+        }
+        if (mode == DUMP_EVERY) {
+            printMap();
+        } else if (mode == DUMP_CHANGED) {
+            printChanged();
+        }
+    }
+    if (failed && trace != nullptr) {
+        trace->dump();
+    }
+    if (mode == DUMP_FINAL) {
+        printMap();
+    }
+}
+
+static const char *SUPERINSTRUCTION_STRING[] = {
+    "inc", "update_mult", "load_mod",
+    "branch_eq", "branch_neq", "branch_leq",
+    "branch_lt", "branch_geq", "branch_gt"
+};
+
+static int getSuperinstruction(OPCODE opcode) {
+    if (opcode >= OP_INC && opcode <= OP_LOAD_MOD) {
+        return opcode - OP_INC;
+    }
+    if (opcode >= OP_BRANCH_EQ && opcode <= OP_BRANCH_GT) {
+        return opcode - OP_BRANCH_EQ + OP_LOAD_MOD - OP_INC + 1;
+    }
+    return UNDEFINED;
+}
+
+void Interpreter::printStatistics() const {
+    int n = sizeof(SUPERINSTRUCTION_STRING) / sizeof(SUPERINSTRUCTION_STRING[0]);
+    vector<long long> emitted(n), executed(n);
+    for (int row = 0; row < program.size(); row++) {
+        for (int pc = program.rowOffset[row]; pc < program.rowOffset[row + 1]; pc++) {
+            int index = getSuperinstruction(program.code[pc].opcode);
+            if (index != UNDEFINED) {
+                emitted[index]++;
+                if (rowCounts.empty() == false) {
+                    executed[index] += rowCounts[row];
+                }
+            }
+        }
+    }
+    err << "-----Superinstructions----" << '\n';
+    for (int i = 0; i < n; i++) {
+        err << SUPERINSTRUCTION_STRING[i] << ": " << emitted[i] <<
+            " emitted, " << executed[i] << " executed" << '\n';
+    }
+    err << "-------------------------" << endl;
+}
+
+bool getDumpMode(string arg, DUMP & mode, int & steps) {
+    string value = arg.substr(arg.find('=') + 1);
+    if (arg.compare(0, 7, "--dump=") != 0) {
+        return false;
+    } else if (value == "none") {
+        mode = DUMP_NONE;
+    } else if (value == "final") {
+        mode = DUMP_FINAL;
+    } else if (value == "changed") {
+        mode = DUMP_CHANGED;
+        steps = 1;
+    } else if (value == "all") {
+        mode = DUMP_EVERY;
+        steps = 1;
+    } else if (value.find_first_not_of("0123456789") == string::npos &&
+               value.empty() == false && value.size() <= 9 &&
+               std::stoi(value) > 0) {
+        mode = DUMP_EVERY;
+        steps = std::stoi(value);
+    } else {
+        return false;
+    }
+    return true;
+}
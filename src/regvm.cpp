@@ -0,0 +1,444 @@
+#include <algorithm>
+#include <climits>
+#include "lexemes.h"
+#include "program.h"
+#include "regvm.h"
+
+using std::endl;
+
+/* The register program is translated from the stack bytecode one row at
+ * a time, tracking where each stack cell would come from. Constants and
+ * variables are not copied anywhere: an instruction reads them where
+ * they are, and only computed values get a register. The register of a
+ * value is its stack depth, which is enough because no value outlives
+ * its row. A variable operand is read when the instruction consuming it
+ * runs, so before a variable is written every pending read of it is
+ * moved into its register. */
+RegisterVm::RegisterVm(const Program & program) : program(program) {
+    scratch = 0;
+}
+
+void RegisterVm::emit(REGISTER_OPCODE opcode, int argument /*= 0*/,
+                      Location target /*= {Location::NONE, 0}*/,
+                      Location left /*= {Location::NONE, 0}*/,
+                      Location right /*= {Location::NONE, 0}*/) {
+    code.push_back({opcode, argument, target, left, right});
+}
+
+void RegisterVm::release(vector<Location> & stack, int slot) {
+    for (int i = 0; i < (int)stack.size(); i++) {
+        if (stack[i].kind == Location::VARIABLE && stack[i].index == slot) {
+            emit(R_MOVE, 0, {Location::REGISTER, i}, stack[i]);
+            stack[i] = {Location::REGISTER, i};
+        }
+    }
+}
+
+bool RegisterVm::compileRow(int row) {
+    vector<Location> stack;
+    for (int pc = program.rowOffset[row]; pc < program.rowOffset[row + 1]; pc++) {
+        const Instruction & instruction = program.code[pc];
+        int operand = instruction.operand;
+        int n = (int)stack.size();
+        Location top = {Location::REGISTER, n - 1};
+        Location under = {Location::REGISTER, n - 2};
+        switch (instruction.opcode) {
+            case OP_PUSH_NUM:
+                stack.push_back({Location::CONSTANT, operand});
+                break;
+            case OP_LOAD:
+            case OP_LOAD_UNDER:
+            case OP_LOAD_MOD:
+                if (std::find(reads.begin() + readOffset.back(), reads.end(),
+                              operand) == reads.end()) {
+                    reads.push_back(operand);
+                }
+                if (instruction.opcode == OP_LOAD) {
+                    stack.push_back({Location::VARIABLE, operand});
+                } else if (instruction.opcode == OP_LOAD_UNDER) {
+                    stack[n - 2] = {Location::VARIABLE, operand};
+                } else {
+                    emit(R_MOD, 0, {Location::REGISTER, n},
+                         {Location::VARIABLE, operand},
+                         {Location::CONSTANT, instruction.argument});
+                    stack.push_back({Location::REGISTER, n});
+                }
+                break;
+            case OP_LOAD_ELEM:
+                emit(R_LOAD_ELEM, operand, top, stack[n - 1]);
+                stack[n - 1] = top;
+                break;
+            case OP_LOAD_ELEM_UNDER:
+                emit(R_LOAD_ELEM, operand, under, stack[n - 2]);
+                stack[n - 2] = under;
+                break;
+            case OP_MULT_POW2:
+            case OP_DIV_POW2:
+            case OP_MOD_POW2:
+                emit(REGISTER_OPCODE(R_MULT_POW2 + instruction.opcode - OP_MULT_POW2),
+                     operand, top, stack[n - 1]);
+                stack[n - 1] = top;
+                break;
+            case OP_STORE:
+                release(stack, operand);
+                emit(R_STORE, operand, {Location::NONE, 0}, stack[n - 1]);
+                break;
+            case OP_STORE_ELEM:
+                emit(R_STORE_ELEM, operand, under, stack[n - 2], stack[n - 1]);
+                stack[n - 2] = stack[n - 1].kind == Location::REGISTER ?
+                               under : stack[n - 1];
+                stack.pop_back();
+                break;
+            case OP_CALL: {
+                int first = n - instruction.argument;
+                for (int i = first; i < n; i++) {
+                    if (stack[i].kind != Location::REGISTER) {
+                        emit(R_MOVE, 0, {Location::REGISTER, i}, stack[i]);
+                    }
+                }
+                emit(R_CALL, operand, {Location::REGISTER, first},
+                     {Location::REGISTER, first});
+                stack.resize(first);
+                stack.push_back({Location::REGISTER, first});
+                break;
+            }
+            case OP_INC:
+            case OP_UPDATE_MULT:
+                release(stack, operand);
+                emit(instruction.opcode == OP_INC ? R_INC : R_UPDATE_MULT, operand,
+                     {Location::NONE, 0}, {Location::CONSTANT, instruction.argument});
+                stack.push_back({Location::VARIABLE, operand});
+                break;
+            case OP_PRINT:
+                emit(R_PRINT, 0, {Location::NONE, 0}, stack[n - 1]);
+                break;
+            case OP_END:
+                emit(R_END);
+                break;
+            case OP_JUMP:
+                emit(R_JUMP, operand);
+                break;
+            case OP_JUMP_FALSE:
+                emit(R_JUMP_FALSE, operand, {Location::NONE, 0}, stack[n - 1]);
+                break;
+            case OP_GOTO:
+                emit(R_GOTO, operand);
+                break;
+            case OP_BRANCH_EQ:
+            case OP_BRANCH_NEQ:
+            case OP_BRANCH_LEQ:
+            case OP_BRANCH_LT:
+            case OP_BRANCH_GEQ:
+            case OP_BRANCH_GT:
+                emit(REGISTER_OPCODE(R_BRANCH_EQ + instruction.opcode - OP_BRANCH_EQ),
+                     instruction.argument, {Location::NONE, 0}, stack[n - 1],
+                     {Location::CONSTANT, operand});
+                break;
+            default:
+                if (instruction.opcode < OP_OR || instruction.opcode > OP_MOD) {
+                    return false;
+                }
+                emit(REGISTER_OPCODE(R_OR + instruction.opcode - OP_OR), 0, under,
+                     stack[n - 2], stack[n - 1]);
+                stack.pop_back();
+                stack[n - 2] = under;
+                break;
+        }
+    }
+    return true;
+}
+
+bool RegisterVm::compile() {
+    code.clear();
+    rowOffset.clear();
+    reads.clear();
+    readOffset.assign(1, 0);
+    for (int row = 0; row < program.size(); row++) {
+        rowOffset.push_back((int)code.size());
+        if (compileRow(row) == false) {
+            return false;
+        }
+        readOffset.push_back((int)reads.size());
+    }
+    rowOffset.push_back((int)code.size());
+    readOffset.push_back((int)reads.size());
+    emit(R_HALT);
+    return true;
+}
+
+int RegisterVm::size() const {
+    return (int)code.size();
+}
+
+int *RegisterVm::locate(Interpreter & interpreter, Location location) {
+    switch (location.kind) {
+        case Location::REGISTER:
+            return &registers[location.index];
+        case Location::VARIABLE:
+            return &interpreter.variables[location.index];
+        case Location::CONSTANT:
+            constants.push_back(location.index);
+            return &constants.back();
+        default:
+            return &scratch;
+    }
+}
+
+/* Operands become plain pointers into the registers, the constant pool
+ * and the interpreter's variables, so no handler looks at a kind. */
+void RegisterVm::link(Interpreter & interpreter) {
+    registers.assign(std::max(program.stackSize, 1), 0);
+    constants.clear();
+    constants.reserve(2 * code.size());
+    linked.clear();
+    for (int i = 0; i < (int)code.size(); i++) {
+        linked.push_back({code[i].opcode, code[i].argument,
+                          locate(interpreter, code[i].target),
+                          locate(interpreter, code[i].left),
+                          locate(interpreter, code[i].right)});
+    }
+    visited.assign(program.size() + 1, false);
+    threaded.clear();
+}
+
+/* A row reads the same variables every time it runs, so they are marked
+ * as defined the first time it is entered rather than on every read. */
+void RegisterVm::enter(Interpreter & interpreter, int row) {
+    visited[row] = true;
+    for (int i = readOffset[row]; i < readOffset[row + 1]; i++) {
+        interpreter.defined[reads[i]] = true;
+    }
+}
+
+static inline int divPow2(int value, int shift) {
+    return (value + ((value >> 31) & ((1 << shift) - 1))) >> shift;
+}
+
+static inline int divide(int left, int right) {
+    return right == -1 ? (int)(0u - (unsigned)left) : left / right;
+}
+
+static inline int modulo(int left, int right) {
+    return right == -1 ? 0 : left % right;
+}
+
+#if defined(__GNUC__) && !defined(SWITCH_DISPATCH)
+#define THREADED_DISPATCH
+#endif
+
+#ifdef THREADED_DISPATCH
+#define TARGET(opcode) \
+            case opcode: \
+            L_##opcode:
+#define DISPATCH() \
+                instruction = &linked[pc]; \
+                goto *threaded[pc++];
+#else
+#define TARGET(opcode) \
+            case opcode:
+#define DISPATCH() \
+                break;
+#endif
+
+#define BINARY_OPERATION(opcode, operation) \
+            TARGET(opcode) \
+                *instruction->target = *instruction->left operation *instruction->right; \
+                DISPATCH()
+
+#define WRAPPING_OPERATION(opcode, operation) \
+            TARGET(opcode) \
+                *instruction->target = (int)((unsigned)*instruction->left operation \
+                                             (unsigned)*instruction->right); \
+                DISPATCH()
+
+#define DIVISION_OPERATION(opcode, operation) \
+            TARGET(opcode) \
+                if (*instruction->right == 0) { \
+                    interpreter.err << "Error: division by zero at line " << \
+                        program.lines[row] + 1 << endl; \
+                    interpreter.failed = true; \
+                    interpreter.row = program.size(); \
+                    return; \
+                } \
+                *instruction->target = operation(*instruction->left, \
+                                                 *instruction->right); \
+                DISPATCH()
+
+#define NEXT_ROW(next) \
+                row = next; \
+                if (--budget == 0) { \
+                    interpreter.row = row; \
+                    return; \
+                } \
+                if (visited[row] == false) { \
+                    enter(interpreter, row); \
+                } \
+                pc = rowOffset[row]; \
+                DISPATCH()
+
+#define BRANCH_OPERATION(opcode, operation) \
+            TARGET(opcode) { \
+                int value = *instruction->left operation *instruction->right; \
+                out << value << '\n'; \
+                NEXT_ROW(value == 0 ? instruction->argument : row + 1) \
+            }
+
+void RegisterVm::run(Interpreter & interpreter, int steps) {
+    long long budget = steps > 0 ? steps : LLONG_MAX;
+    ostream & out = interpreter.out;
+    int row = interpreter.row;
+    int pc = rowOffset[row];
+    const RegisterInstruction *instruction;
+#ifdef THREADED_DISPATCH
+    static const void *handlers[] = {
+        &&L_R_OR,
+        &&L_R_AND,
+        &&L_R_BITOR,
+        &&L_R_XOR,
+        &&L_R_BITAND,
+        &&L_R_EQ,
+        &&L_R_NEQ,
+        &&L_R_LEQ, &&L_R_SHL,
+        &&L_R_LT,
+        &&L_R_GEQ, &&L_R_SHR,
+        &&L_R_GT,
+        &&L_R_PLUS, &&L_R_MINUS,
+        &&L_R_MULT, &&L_R_DIV, &&L_R_MOD,
+        &&L_R_MULT_POW2, &&L_R_DIV_POW2, &&L_R_MOD_POW2,
+        &&L_R_MOVE, &&L_R_LOAD_ELEM,
+        &&L_R_STORE, &&L_R_STORE_ELEM, &&L_R_CALL,
+        &&L_R_INC, &&L_R_UPDATE_MULT,
+        &&L_R_PRINT,
+        &&L_R_END, &&L_R_JUMP, &&L_R_JUMP_FALSE, &&L_R_GOTO,
+        &&L_R_BRANCH_EQ,
+        &&L_R_BRANCH_NEQ,
+        &&L_R_BRANCH_LEQ,
+        &&L_R_BRANCH_LT,
+        &&L_R_BRANCH_GEQ,
+        &&L_R_BRANCH_GT,
+        &&L_R_HALT
+    };
+    static_assert(sizeof(handlers) / sizeof(handlers[0]) == R_HALT + 1,
+                  "every opcode needs a handler");
+    if (threaded.empty()) {
+        for (int i = 0; i < (int)linked.size(); i++) {
+            threaded.push_back(handlers[linked[i].opcode]);
+        }
+    }
+#endif
+    if (visited[row] == false) {
+        enter(interpreter, row);
+    }
+    while (true) {
+        instruction = &linked[pc++];
+        switch (instruction->opcode) {
+            BINARY_OPERATION(R_OR, ||)
+            BINARY_OPERATION(R_AND, &&)
+            BINARY_OPERATION(R_BITOR, |)
+            BINARY_OPERATION(R_XOR, ^)
+            BINARY_OPERATION(R_BITAND, &)
+            BINARY_OPERATION(R_EQ, ==)
+            BINARY_OPERATION(R_NEQ, !=)
+            BINARY_OPERATION(R_LEQ, <=)
+            BINARY_OPERATION(R_SHL, <<)
+            BINARY_OPERATION(R_LT, <)
+            BINARY_OPERATION(R_GEQ, >=)
+            BINARY_OPERATION(R_SHR, >>)
+            BINARY_OPERATION(R_GT, >)
+            WRAPPING_OPERATION(R_PLUS, +)
+            WRAPPING_OPERATION(R_MINUS, -)
+            WRAPPING_OPERATION(R_MULT, *)
+            DIVISION_OPERATION(R_DIV, divide)
+            DIVISION_OPERATION(R_MOD, modulo)
+            TARGET(R_MULT_POW2)
+                *instruction->target = (int)((unsigned)*instruction->left <<
+                                             instruction->argument);
+                DISPATCH()
+            TARGET(R_DIV_POW2)
+                *instruction->target = divPow2(*instruction->left,
+                                               instruction->argument);
+                DISPATCH()
+            TARGET(R_MOD_POW2)
+                *instruction->target = *instruction->left - (int)((unsigned)divPow2(
+                    *instruction->left, instruction->argument) << instruction->argument);
+                DISPATCH()
+            TARGET(R_MOVE)
+                *instruction->target = *instruction->left;
+                DISPATCH()
+            TARGET(R_LOAD_ELEM)
+                *instruction->target =
+                    interpreter.arrays[instruction->argument].load(*instruction->left);
+                DISPATCH()
+            TARGET(R_STORE)
+                interpreter.defined[instruction->argument] = true;
+                interpreter.dirty[instruction->argument] = true;
+                interpreter.variables[instruction->argument] = *instruction->left;
+                DISPATCH()
+            TARGET(R_STORE_ELEM)
+                interpreter.arrayDirty[instruction->argument] = true;
+                interpreter.arrays[instruction->argument].store(*instruction->left,
+                                                                *instruction->right);
+                *instruction->target = *instruction->right;
+                DISPATCH()
+            TARGET(R_CALL)
+                *instruction->target = interpreter.call(instruction->argument,
+                                                        instruction->left);
+                DISPATCH()
+            TARGET(R_INC)
+                interpreter.defined[instruction->argument] = true;
+                interpreter.dirty[instruction->argument] = true;
+                interpreter.variables[instruction->argument] = (int)(
+                    (unsigned)interpreter.variables[instruction->argument] +
+                    (unsigned)*instruction->left);
+                DISPATCH()
+            TARGET(R_UPDATE_MULT)
+                interpreter.defined[instruction->argument] = true;
+                interpreter.dirty[instruction->argument] = true;
+                interpreter.variables[instruction->argument] = (int)(
+                    (unsigned)interpreter.variables[instruction->argument] *
+                    (unsigned)*instruction->left);
+                DISPATCH()
+            TARGET(R_PRINT)
+                out << *instruction->left << '\n';
+                DISPATCH()
+            TARGET(R_END)
+                NEXT_ROW(row + 1)
+            TARGET(R_JUMP)
+                NEXT_ROW(instruction->argument)
+            TARGET(R_JUMP_FALSE)
+                NEXT_ROW(*instruction->left == 0 ? instruction->argument : row + 1)
+            TARGET(R_GOTO)
+                interpreter.err << "Error: undefined label " <<
+                    program.symbols[instruction->argument] << endl;
+                interpreter.row = program.size();
+                return;
+            BRANCH_OPERATION(R_BRANCH_EQ, ==)
+            BRANCH_OPERATION(R_BRANCH_NEQ, !=)
+            BRANCH_OPERATION(R_BRANCH_LEQ, <=)
+            BRANCH_OPERATION(R_BRANCH_LT, <)
+            BRANCH_OPERATION(R_BRANCH_GEQ, >=)
+            BRANCH_OPERATION(R_BRANCH_GT, >)
+            TARGET(R_HALT)
+                interpreter.row = row;
+                return;
+        }
+    }
+}
+
+void RegisterVm::execute(Interpreter & interpreter, DUMP mode, int steps) {
+    link(interpreter);
+    if (mode != DUMP_EVERY && mode != DUMP_CHANGED) {
+        steps = 0;
+    }
+    while (interpreter.isFinished() == false) {
+        run(interpreter, steps);
+        if (mode == DUMP_EVERY) {
+            interpreter.printMap();
+        } else if (mode == DUMP_CHANGED) {
+            interpreter.printChanged();
+        }
+    }
+    if (mode == DUMP_FINAL) {
+        interpreter.printMap();
+    }
+}
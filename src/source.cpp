@@ -0,0 +1,84 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "lexemes.h"
+#include "tokenizer.h"
+#include "source.h"
+
+/* Regular files are mapped and the parser sees string_view lines over the
+ * mapping. Pipes and terminals are read once into a single buffer. */
+Source::Source() {
+    mapping = nullptr;
+    mappingSize = 0;
+}
+
+Source::~Source() {
+    if (mapping != nullptr) {
+        munmap(mapping, mappingSize);
+    }
+}
+
+void Source::split(string_view text) {
+    size_t begin = 0;
+    lines.clear();
+    while (begin < text.size()) {
+        size_t end = text.find('\n', begin);
+        if (end == string_view::npos) {
+            end = text.size();
+        }
+        lines.push_back(text.substr(begin, end - begin));
+        begin = end + 1;
+    }
+}
+
+bool Source::mapFile(int fd) {
+    struct stat info;
+    if (fstat(fd, &info) != 0 || S_ISREG(info.st_mode) == false) {
+        return false;
+    }
+    if (info.st_size == 0) {
+        lines.clear();
+        return true;
+    }
+    void *address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED) {
+        return false;
+    }
+    madvise(address, info.st_size, MADV_SEQUENTIAL);
+    mapping = (char *)address;
+    mappingSize = info.st_size;
+    split(string_view(mapping, mappingSize));
+    return true;
+}
+
+bool Source::load(int fd) {
+    if (mapFile(fd)) {
+        return true;
+    }
+    char chunk[64 * 1024];
+    ssize_t count;
+    while ((count = read(fd, chunk, sizeof(chunk))) > 0) {
+        buffer.append(chunk, count);
+    }
+    split(buffer);
+    return count == 0;
+}
+
+bool Source::open(const string & path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool loaded = load(fd);
+    close(fd);
+    return loaded;
+}
+
+bool Source::readStdin() {
+    return load(STDIN_FILENO);
+}
+
+const vector<string_view> & Source::getLines() const {
+    return lines;
+}
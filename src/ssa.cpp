@@ -0,0 +1,796 @@
+#include <algorithm>
+#include <climits>
+#include <map>
+#include "lexemes.h"
+#include "program.h"
+#include "cfg.h"
+#include "ssa.h"
+
+using std::to_string;
+
+static bool isBinary(OPCODE opcode) {
+    return opcode >= OP_OR && opcode <= OP_MOD;
+}
+
+static bool isCommutative(OPCODE opcode) {
+    return opcode == OP_OR || opcode == OP_AND || opcode == OP_BITOR ||
+           opcode == OP_XOR || opcode == OP_BITAND || opcode == OP_EQ ||
+           opcode == OP_NEQ || opcode == OP_PLUS || opcode == OP_MULT;
+}
+
+/* The middle-end works on the bytecode straight from the compiler, before
+ * the optimizer folds or fuses anything. Every row is executed
+ * symbolically: stack cells become SSA values, a variable's version is
+ * the value last stored into it (or a phi where control flow merges), and
+ * equal operations on equal values are the same value. Copies therefore
+ * need no pass of their own: y := x gives y the value of x. The results
+ * are lowered back into the rows as plain instructions:
+ *
+ *   - a load of a variable holding a constant becomes the constant;
+ *   - an expression whose value some variable already holds becomes a
+ *     load of that variable (global CSE);
+ *   - an expression that a loop cannot change is computed once in a new
+ *     row in front of the loop (LICM);
+ *   - i * k, where i only changes by constants in the loop, is kept in a
+ *     temporary that is stepped next to every update of i.
+ *
+ * The hoisted values live in hidden variables named $N. Only runs whose
+ * rows are not observed one by one use this, as with dead stores. */
+Ssa::Ssa(Program & program) : program(program), cfg(program) {
+}
+
+int Ssa::getConstant(int value) {
+    unordered_map<int, int>::const_iterator it = constants.find(value);
+    if (it != constants.end()) {
+        return it->second;
+    }
+    values.push_back({Value::CONSTANT, value, 0, 0});
+    constants[value] = (int)values.size() - 1;
+    return (int)values.size() - 1;
+}
+
+int Ssa::getOperation(OPCODE opcode, int left, int right) {
+    const Value & a = values[left];
+    const Value & b = values[right];
+    if (a.kind == Value::CONSTANT && b.kind == Value::CONSTANT &&
+        ((opcode != OP_DIV && opcode != OP_MOD) ||
+         (b.operand != 0 && (a.operand != INT_MIN || b.operand != -1))) &&
+        ((opcode != OP_SHL && opcode != OP_SHR) ||
+         (b.operand >= 0 && b.operand <= 31))) {
+        Binary binary(OPERATOR(opcode - OP_OR + OR));
+        return getConstant(binary.getValue(a.operand, b.operand));
+    }
+    if (isCommutative(opcode) && left > right) {
+        std::swap(left, right);
+    }
+    long long key = ((long long)opcode << 58) | ((long long)left << 29) | right;
+    unordered_map<long long, int>::const_iterator it = operations.find(key);
+    if (it != operations.end()) {
+        return it->second;
+    }
+    values.push_back({Value::OPERATION, opcode, left, right});
+    operations[key] = (int)values.size() - 1;
+    return (int)values.size() - 1;
+}
+
+int Ssa::getOpaque() {
+    values.push_back({Value::OPAQUE, 0, 0, 0});
+    return (int)values.size() - 1;
+}
+
+void Ssa::setVersion(int slot, int value) {
+    changes.push_back({slot, current[slot]});
+    current[slot] = value;
+    holders[value].push_back(slot);
+}
+
+void Ssa::undo(int mark) {
+    while ((int)changes.size() > mark) {
+        const Change & change = changes.back();
+        holders[current[change.slot]].pop_back();
+        current[change.slot] = change.version;
+        changes.pop_back();
+    }
+}
+
+/* A variable whose current version is the value, if there is one. */
+int Ssa::getHolder(int value) const {
+    unordered_map<int, vector<int>>::const_iterator it = holders.find(value);
+    if (it == holders.end()) {
+        return UNDEFINED;
+    }
+    for (int i = (int)it->second.size() - 1; i >= 0; i--) {
+        if (current[it->second[i]] == value) {
+            return it->second[i];
+        }
+    }
+    return UNDEFINED;
+}
+
+bool Ssa::isSupported() const {
+    for (int pc = 0; pc < (int)program.code.size(); pc++) {
+        OPCODE opcode = program.code[pc].opcode;
+        if (opcode != OP_PUSH_NUM && opcode != OP_LOAD && opcode != OP_LOAD_UNDER &&
+            opcode != OP_LOAD_ELEM && opcode != OP_LOAD_ELEM_UNDER &&
+            isBinary(opcode) == false && opcode != OP_STORE &&
+            opcode != OP_STORE_ELEM && opcode != OP_CALL && opcode != OP_PRINT &&
+            opcode != OP_END && opcode != OP_JUMP && opcode != OP_JUMP_FALSE &&
+            opcode != OP_GOTO && opcode != OP_HALT) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Whether every path to this version went through a store. Only then has
+ * the variable certainly been marked as defined before it is read. */
+bool Ssa::isStored(int version) const {
+    if (values[version].kind == Value::ENTRY) {
+        return false;
+    }
+    return values[version].kind != Value::PHI || phiStored[values[version].right];
+}
+
+/* i * k or k * i, with i not yet stored in this row. */
+int Ssa::getInduction(int begin, int end, const vector<int> & stored) const {
+    if (end - begin != 3 || program.code[begin + 2].opcode != OP_MULT) {
+        return UNDEFINED;
+    }
+    const Instruction & first = program.code[begin];
+    const Instruction & second = program.code[begin + 1];
+    int slot = UNDEFINED;
+    if (first.opcode == OP_LOAD && second.opcode == OP_PUSH_NUM) {
+        slot = first.operand;
+    } else if (first.opcode == OP_PUSH_NUM && second.opcode == OP_LOAD) {
+        slot = second.operand;
+    }
+    if (slot == UNDEFINED ||
+        std::find(stored.begin(), stored.end(), slot) != stored.end()) {
+        return UNDEFINED;
+    }
+    return slot;
+}
+
+/* Cooper, Harvey and Kennedy's iterative algorithm over reverse
+ * postorder. Unreachable blocks keep UNDEFINED as their dominator. */
+void Ssa::findDominators() {
+    const vector<BasicBlock> & blocks = cfg.getBlocks();
+    int n = (int)blocks.size();
+    vector<char> seen(n, false);
+    vector<pair<int, int>> stack = {{0, 0}};
+    seen[0] = true;
+    while (stack.empty() == false) {
+        pair<int, int> & top = stack.back();
+        const vector<int> & successors = blocks[top.first].successors;
+        if (top.second < (int)successors.size()) {
+            int next = successors[top.second++];
+            if (next != ControlFlowGraph::EXIT && seen[next] == false) {
+                seen[next] = true;
+                stack.push_back({next, 0});
+            }
+        } else {
+            order.push_back(top.first);
+            stack.pop_back();
+        }
+    }
+    std::reverse(order.begin(), order.end());
+    vector<int> position(n, UNDEFINED);
+    for (int i = 0; i < (int)order.size(); i++) {
+        position[order[i]] = i;
+    }
+    idom.assign(n, UNDEFINED);
+    idom[0] = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 1; i < (int)order.size(); i++) {
+            int block = order[i];
+            int dominator = UNDEFINED;
+            const vector<int> & predecessors = blocks[block].predecessors;
+            for (int k = 0; k < (int)predecessors.size(); k++) {
+                int other = predecessors[k];
+                if (idom[other] == UNDEFINED) {
+                    continue;
+                }
+                while (dominator != UNDEFINED && other != dominator) {
+                    while (position[other] > position[dominator]) {
+                        other = idom[other];
+                    }
+                    while (position[dominator] > position[other]) {
+                        dominator = idom[dominator];
+                    }
+                }
+                dominator = other;
+            }
+            if (idom[block] != dominator) {
+                idom[block] = dominator;
+                changed = true;
+            }
+        }
+    }
+}
+
+/* A loop is a back edge to a header that dominates it, taken together
+ * with every row from the header down to the last latch. The range must
+ * be entered through the header only, so that a new row placed right in
+ * front of the header runs exactly once per entry. */
+void Ssa::findLoops() {
+    const vector<BasicBlock> & blocks = cfg.getBlocks();
+    int n = (int)blocks.size();
+    vector<vector<int>> children(n);
+    for (int i = 1; i < (int)order.size(); i++) {
+        children[idom[order[i]]].push_back(order[i]);
+    }
+    vector<int> enter(n), leave(n);
+    vector<pair<int, int>> stack = {{0, 0}};
+    int clock = 0;
+    enter[0] = clock++;
+    while (stack.empty() == false) {
+        pair<int, int> & top = stack.back();
+        if (top.second < (int)children[top.first].size()) {
+            int child = children[top.first][top.second++];
+            enter[child] = clock++;
+            stack.push_back({child, 0});
+        } else {
+            leave[top.first] = clock++;
+            stack.pop_back();
+        }
+    }
+    vector<int> latch(n, UNDEFINED);
+    for (int i = 0; i < (int)order.size(); i++) {
+        int block = order[i];
+        const vector<int> & successors = blocks[block].successors;
+        for (int k = 0; k < (int)successors.size(); k++) {
+            int header = successors[k];
+            if (header != ControlFlowGraph::EXIT && enter[header] <= enter[block] &&
+                leave[block] <= leave[header]) {
+                latch[header] = std::max(latch[header], block);
+            }
+        }
+    }
+    for (int header = 0; header < n; header++) {
+        if (latch[header] < header) {
+            continue;
+        }
+        bool single = true;
+        for (int block = header + 1; block <= latch[header] && single; block++) {
+            const vector<int> & predecessors = blocks[block].predecessors;
+            for (int k = 0; k < (int)predecessors.size(); k++) {
+                int other = predecessors[k];
+                if (idom[other] != UNDEFINED && (other < header || other > latch[header])) {
+                    single = false;
+                }
+            }
+        }
+        if (single) {
+            loops.push_back({header, blocks[header].first, blocks[latch[header]].last});
+        }
+    }
+}
+
+/* Phis go on the iterated dominance frontier of the blocks that store to
+ * a variable. */
+void Ssa::placePhis() {
+    const vector<BasicBlock> & blocks = cfg.getBlocks();
+    int n = (int)blocks.size();
+    vector<vector<int>> frontier(n);
+    for (int i = 0; i < (int)order.size(); i++) {
+        int block = order[i];
+        const vector<int> & predecessors = blocks[block].predecessors;
+        if (predecessors.size() < 2) {
+            continue;
+        }
+        for (int k = 0; k < (int)predecessors.size(); k++) {
+            int runner = predecessors[k];
+            if (idom[runner] == UNDEFINED) {
+                continue;
+            }
+            while (runner != idom[block]) {
+                if (frontier[runner].empty() || frontier[runner].back() != block) {
+                    frontier[runner].push_back(block);
+                }
+                runner = idom[runner];
+            }
+        }
+    }
+    int symbols = (int)program.symbols.size();
+    vector<vector<int>> definitions(symbols);
+    for (int i = 0; i < (int)order.size(); i++) {
+        const BasicBlock & block = blocks[order[i]];
+        for (int pc = program.rowOffset[block.first];
+             pc < program.rowOffset[block.last + 1]; pc++) {
+            if (program.code[pc].opcode == OP_STORE) {
+                vector<int> & sites = definitions[program.code[pc].operand];
+                if (sites.empty() || sites.back() != order[i]) {
+                    sites.push_back(order[i]);
+                }
+            }
+        }
+    }
+    phis.assign(n, {});
+    vector<int> placed(n, UNDEFINED);
+    vector<int> queued(n, UNDEFINED);
+    for (int slot = 0; slot < symbols; slot++) {
+        vector<int> work = definitions[slot];
+        for (int i = 0; i < (int)work.size(); i++) {
+            queued[work[i]] = slot;
+        }
+        while (work.empty() == false) {
+            int block = work.back();
+            work.pop_back();
+            for (int i = 0; i < (int)frontier[block].size(); i++) {
+                int join = frontier[block][i];
+                if (placed[join] == slot) {
+                    continue;
+                }
+                placed[join] = slot;
+                values.push_back({Value::PHI, slot, join, (int)phiInputs.size()});
+                phiInputs.push_back({});
+                phis[join].push_back((int)values.size() - 1);
+                if (queued[join] != slot) {
+                    queued[join] = slot;
+                    work.push_back(join);
+                }
+            }
+        }
+    }
+}
+
+void Ssa::renameRow(int row) {
+    vector<Cell> stack;
+    vector<int> stored;
+    int first = (int)candidates.size();
+    for (int pc = program.rowOffset[row]; pc < program.rowOffset[row + 1]; pc++) {
+        const Instruction & instruction = program.code[pc];
+        int operand = instruction.operand;
+        int n = (int)stack.size();
+        switch (instruction.opcode) {
+            case OP_PUSH_NUM:
+                stack.push_back({getConstant(operand), pc, pc + 1, true, false});
+                break;
+            case OP_LOAD:
+                loadVersion[pc] = current[operand];
+                stack.push_back({current[operand], pc, pc + 1, true, false});
+                if (values[current[operand]].kind == Value::CONSTANT) {
+                    candidates.push_back({row, pc, pc + 1, current[operand],
+                                          UNDEFINED, UNDEFINED, false});
+                }
+                break;
+            case OP_LOAD_UNDER:
+                loadVersion[pc] = current[operand];
+                stack[n - 2] = {current[operand], UNDEFINED, UNDEFINED, false, false};
+                break;
+            case OP_LOAD_ELEM:
+                stack[n - 1] = {getOpaque(), stack[n - 1].begin, pc + 1, false, false};
+                break;
+            case OP_LOAD_ELEM_UNDER:
+                stack[n - 2] = {getOpaque(), UNDEFINED, UNDEFINED, false, false};
+                break;
+            case OP_STORE:
+                stores.push_back({row, operand, stack[n - 1].value, current[operand]});
+                setVersion(operand, stack[n - 1].value);
+                stored.push_back(operand);
+                stack[n - 1] = {stack[n - 1].value, stack[n - 1].begin, pc + 1,
+                                false, false};
+                break;
+            case OP_STORE_ELEM:
+                stack[n - 2] = {stack[n - 1].value, stack[n - 2].begin, pc + 1,
+                                false, false};
+                stack.pop_back();
+                break;
+            case OP_CALL:
+                stack.resize(n - instruction.argument);
+                stack.push_back({getOpaque(), UNDEFINED, UNDEFINED, false, false});
+                break;
+            case OP_PRINT:
+            case OP_END:
+            case OP_JUMP:
+            case OP_JUMP_FALSE:
+            case OP_GOTO:
+                break;
+            default: {
+                const Cell & left = stack[n - 2];
+                const Cell & right = stack[n - 1];
+                bool pure = left.pure && right.pure && left.end == right.begin &&
+                            right.end == pc;
+                bool unsafe = left.unsafe || right.unsafe;
+                if (instruction.opcode == OP_DIV || instruction.opcode == OP_MOD) {
+                    const Value & divisor = values[right.value];
+                    unsafe = unsafe || divisor.kind != Value::CONSTANT ||
+                             divisor.operand == 0 || divisor.operand == -1;
+                }
+                int value = getOperation(instruction.opcode, left.value, right.value);
+                Cell cell = {value, pure ? left.begin : UNDEFINED,
+                             pure ? pc + 1 : UNDEFINED, pure, unsafe};
+                stack.pop_back();
+                stack[n - 2] = cell;
+                int holder = pure ? getHolder(value) : UNDEFINED;
+                if (pure && (holder != UNDEFINED || innermost[row] != UNDEFINED ||
+                             values[value].kind == Value::CONSTANT)) {
+                    candidates.push_back({row, cell.begin, cell.end, value, holder,
+                                          getInduction(cell.begin, cell.end, stored),
+                                          unsafe});
+                }
+                break;
+            }
+        }
+    }
+    std::sort(candidates.begin() + first, candidates.end(),
+              [](const Candidate & a, const Candidate & b) {
+        return a.begin < b.begin || (a.begin == b.begin && a.end > b.end);
+    });
+}
+
+/* Walks the dominator tree, so that every row sees the versions that
+ * reach it, and fills in the phi inputs of each successor on the way. */
+void Ssa::rename() {
+    const vector<BasicBlock> & blocks = cfg.getBlocks();
+    int n = (int)blocks.size();
+    vector<vector<int>> children(n);
+    for (int i = 1; i < (int)order.size(); i++) {
+        children[idom[order[i]]].push_back(order[i]);
+    }
+    current.resize(program.symbols.size());
+    for (int slot = 0; slot < (int)current.size(); slot++) {
+        values.push_back({Value::ENTRY, slot, 0, 0});
+        current[slot] = (int)values.size() - 1;
+    }
+    loadVersion.assign(program.code.size(), UNDEFINED);
+    vector<pair<int, int>> stack = {{0, UNDEFINED}};
+    while (stack.empty() == false) {
+        int block = stack.back().first;
+        if (stack.back().second != UNDEFINED) {
+            undo(stack.back().second);
+            stack.pop_back();
+            continue;
+        }
+        stack.back().second = (int)changes.size();
+        for (int i = 0; i < (int)phis[block].size(); i++) {
+            setVersion(values[phis[block][i]].operand, phis[block][i]);
+        }
+        for (int row = blocks[block].first; row <= blocks[block].last; row++) {
+            renameRow(row);
+        }
+        const vector<int> & successors = blocks[block].successors;
+        for (int k = 0; k < (int)successors.size(); k++) {
+            if (successors[k] == ControlFlowGraph::EXIT) {
+                continue;
+            }
+            const vector<int> & joins = phis[successors[k]];
+            for (int i = 0; i < (int)joins.size(); i++) {
+                const Value & phi = values[joins[i]];
+                phiInputs[phi.right].push_back({block, current[phi.operand]});
+            }
+        }
+        for (int i = 0; i < (int)children[block].size(); i++) {
+            stack.push_back({children[block][i], UNDEFINED});
+        }
+    }
+}
+
+/* A phi is stored unless one of its inputs, through any chain of phis,
+ * is the initial value of the variable. */
+void Ssa::markStored() {
+    phiStored.assign(phiInputs.size(), true);
+    vector<vector<int>> users(phiInputs.size());
+    vector<int> work;
+    for (int phi = 0; phi < (int)phiInputs.size(); phi++) {
+        for (int i = 0; i < (int)phiInputs[phi].size(); i++) {
+            const Value & input = values[phiInputs[phi][i].second];
+            if (input.kind == Value::ENTRY && phiStored[phi]) {
+                phiStored[phi] = false;
+                work.push_back(phi);
+            } else if (input.kind == Value::PHI) {
+                users[input.right].push_back(phi);
+            }
+        }
+    }
+    while (work.empty() == false) {
+        int phi = work.back();
+        work.pop_back();
+        for (int i = 0; i < (int)users[phi].size(); i++) {
+            if (phiStored[users[phi][i]]) {
+                phiStored[users[phi][i]] = false;
+                work.push_back(users[phi][i]);
+            }
+        }
+    }
+}
+
+bool Ssa::isHoistable(const Candidate & candidate, int loop) const {
+    const Loop & range = loops[loop];
+    if (candidate.unsafe || values[candidate.value].kind != Value::OPERATION) {
+        return false;
+    }
+    bool header = cfg.getBlock(candidate.row) == range.header;
+    for (int pc = candidate.begin; pc < candidate.end; pc++) {
+        if (program.code[pc].opcode != OP_LOAD) {
+            continue;
+        }
+        const vector<int> & rows = storeRows[program.code[pc].operand];
+        vector<int>::const_iterator it = std::lower_bound(rows.begin(), rows.end(),
+                                                          range.first);
+        if ((it != rows.end() && *it <= range.last) ||
+            (header == false && isStored(loadVersion[pc]) == false)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Every store to the variable inside the loop adds a constant to it, at
+ * most once per row, in a row whose terminator does not read the stack,
+ * and it has been stored on every path into the loop. */
+bool Ssa::isInduction(int loop, int slot) const {
+    const Loop & range = loops[loop];
+    const vector<int> & rows = storeRows[slot];
+    vector<int>::const_iterator it = std::lower_bound(rows.begin(), rows.end(),
+                                                      range.first);
+    if (it == rows.end() || *it > range.last) {
+        return false;
+    }
+    for (; it != rows.end() && *it <= range.last; it++) {
+        if (it + 1 != rows.end() && it[1] == *it) {
+            return false;
+        }
+        OPCODE terminator = program.code[program.rowOffset[*it + 1] - 1].opcode;
+        if (terminator != OP_END && terminator != OP_JUMP) {
+            return false;
+        }
+    }
+    for (int i = 0; i < (int)stores.size(); i++) {
+        int step;
+        if (stores[i].slot == slot && stores[i].row >= range.first &&
+            stores[i].row <= range.last && getStep(stores[i], step) == false) {
+            return false;
+        }
+    }
+    const vector<int> & joins = phis[range.header];
+    for (int i = 0; i < (int)joins.size(); i++) {
+        if (values[joins[i]].operand == slot) {
+            return isStored(joins[i]);
+        }
+    }
+    return false;
+}
+
+bool Ssa::getStep(const Store & store, int & step) const {
+    const Value & value = values[store.value];
+    if (value.kind != Value::OPERATION) {
+        return false;
+    }
+    int other;
+    if (value.left == store.previous) {
+        other = value.right;
+    } else if (value.right == store.previous && value.operand == OP_PLUS) {
+        other = value.left;
+    } else {
+        return false;
+    }
+    if (values[other].kind != Value::CONSTANT ||
+        (value.operand != OP_PLUS && value.operand != OP_MINUS)) {
+        return false;
+    }
+    step = value.operand == OP_PLUS ? values[other].operand :
+           (int)(0u - (unsigned)values[other].operand);
+    return true;
+}
+
+/* Loops around a row, innermost first. */
+vector<int> Ssa::getLoops(int row) const {
+    vector<int> around;
+    for (int loop = innermost[row]; loop != UNDEFINED; loop = parent[loop]) {
+        around.push_back(loop);
+    }
+    return around;
+}
+
+void Ssa::nestLoops() {
+    std::sort(loops.begin(), loops.end(), [](const Loop & a, const Loop & b) {
+        return a.first < b.first || (a.first == b.first && a.last > b.last);
+    });
+    innermost.assign(program.size(), UNDEFINED);
+    parent.assign(loops.size(), UNDEFINED);
+    vector<int> open;
+    int next = 0;
+    for (int row = 0; row < program.size(); row++) {
+        while (open.empty() == false && loops[open.back()].last < row) {
+            open.pop_back();
+        }
+        while (next < (int)loops.size() && loops[next].first == row) {
+            parent[next] = open.empty() ? UNDEFINED : open.back();
+            open.push_back(next++);
+        }
+        innermost[row] = open.empty() ? UNDEFINED : open.back();
+    }
+}
+
+int Ssa::addTemporary() {
+    program.symbols.push_back("$" + to_string(program.symbols.size()));
+    program.labels.push_back(UNDEFINED);
+    return (int)program.symbols.size() - 1;
+}
+
+/* The new row takes the header's place: entries from outside the loop now
+ * run it first, while the back edges still go to the header itself. */
+void Ssa::insertPreheader(vector<vector<Instruction>> & rows, int loop,
+                          const vector<Instruction> & code) {
+    int header = loops[loop].first;
+    int last = loops[loop].last;
+    for (int row = 0; row < (int)rows.size(); row++) {
+        bool inside = row >= header && row <= last;
+        for (int i = 0; i < (int)rows[row].size(); i++) {
+            Instruction & instruction = rows[row][i];
+            if (instruction.opcode != OP_JUMP && instruction.opcode != OP_JUMP_FALSE) {
+                continue;
+            }
+            if (instruction.operand > header ||
+                (instruction.operand == header && inside)) {
+                instruction.operand++;
+            }
+        }
+    }
+    for (int i = 0; i < (int)program.labels.size(); i++) {
+        if (program.labels[i] > header) {
+            program.labels[i]++;
+        }
+    }
+    rows.insert(rows.begin() + header, code);
+    rows[header].push_back({OP_END, 0, 0});
+    program.lines.insert(program.lines.begin() + header, program.lines[header]);
+    for (int other = 0; other < (int)loops.size(); other++) {
+        if (loops[other].first > header || other == loop) {
+            loops[other].first++;
+        }
+        if (loops[other].last >= header) {
+            loops[other].last++;
+        }
+    }
+}
+
+void Ssa::rewrite() {
+    struct Edit {
+        int begin;
+        int end;
+        Instruction instruction;
+    };
+    vector<vector<Edit>> edits(program.size());
+    vector<vector<Instruction>> preheaders(loops.size());
+    std::map<pair<int, int>, int> hoisted;
+    std::map<pair<int, pair<int, int>>, int> inductions;
+    int row = UNDEFINED;
+    int end = UNDEFINED;
+    for (int i = 0; i < (int)candidates.size(); i++) {
+        const Candidate & candidate = candidates[i];
+        const Value & value = values[candidate.value];
+        if (candidate.row == row && candidate.begin < end) {
+            continue;
+        }
+        Instruction instruction = {OP_HALT, 0, 0};
+        if (value.kind == Value::CONSTANT) {
+            instruction = {OP_PUSH_NUM, value.operand, 0};
+        } else if (candidate.holder != UNDEFINED && value.kind == Value::OPERATION) {
+            instruction = {OP_LOAD, candidate.holder, 0};
+        }
+        vector<int> around = getLoops(candidate.row);
+        for (int k = (int)around.size() - 1;
+             k >= 0 && instruction.opcode == OP_HALT; k--) {
+            if (isHoistable(candidate, around[k]) == false) {
+                continue;
+            }
+            pair<int, int> key = {around[k], candidate.value};
+            if (hoisted.count(key) == 0) {
+                hoisted[key] = addTemporary();
+                vector<Instruction> & code = preheaders[around[k]];
+                code.insert(code.end(), program.code.begin() + candidate.begin,
+                            program.code.begin() + candidate.end);
+                code.push_back({OP_STORE, hoisted[key], 0});
+            }
+            instruction = {OP_LOAD, hoisted[key], 0};
+        }
+        int slot = candidate.induction;
+        for (int k = 0; k < (int)around.size() && slot != UNDEFINED &&
+                        instruction.opcode == OP_HALT; k++) {
+            const vector<int> & rows = storeRows[slot];
+            vector<int>::const_iterator it = std::lower_bound(rows.begin(), rows.end(),
+                                                              loops[around[k]].first);
+            if (it == rows.end() || *it > loops[around[k]].last) {
+                continue;
+            }
+            if (isInduction(around[k], slot)) {
+                const Instruction & first = program.code[candidate.begin];
+                int factor = first.opcode == OP_PUSH_NUM ? first.operand :
+                             program.code[candidate.begin + 1].operand;
+                pair<int, pair<int, int>> key = {around[k], {slot, factor}};
+                if (inductions.count(key) == 0) {
+                    inductions[key] = addTemporary();
+                }
+                instruction = {OP_LOAD, inductions[key], 0};
+            }
+            break;
+        }
+        if (instruction.opcode != OP_HALT) {
+            edits[candidate.row].push_back({candidate.begin, candidate.end, instruction});
+            row = candidate.row;
+            end = candidate.end;
+        }
+    }
+    vector<vector<Instruction>> rows(program.size());
+    for (int i = 0; i < program.size(); i++) {
+        rows[i].assign(program.code.begin() + program.rowOffset[i],
+                       program.code.begin() + program.rowOffset[i + 1]);
+        for (int k = (int)edits[i].size() - 1; k >= 0; k--) {
+            const Edit & edit = edits[i][k];
+            int offset = program.rowOffset[i];
+            rows[i].erase(rows[i].begin() + edit.begin - offset + 1,
+                          rows[i].begin() + edit.end - offset);
+            rows[i][edit.begin - offset] = edit.instruction;
+        }
+    }
+    std::map<pair<int, pair<int, int>>, int>::const_iterator it;
+    for (it = inductions.begin(); it != inductions.end(); it++) {
+        const Loop & range = loops[it->first.first];
+        int slot = it->first.second.first;
+        int factor = it->first.second.second;
+        vector<Instruction> & code = preheaders[it->first.first];
+        code.push_back({OP_LOAD, slot, 0});
+        code.push_back({OP_PUSH_NUM, factor, 0});
+        code.push_back({OP_MULT, 0, 0});
+        code.push_back({OP_STORE, it->second, 0});
+        for (int i = 0; i < (int)stores.size(); i++) {
+            int step;
+            if (stores[i].slot != slot || stores[i].row < range.first ||
+                stores[i].row > range.last || getStep(stores[i], step) == false) {
+                continue;
+            }
+            vector<Instruction> & update = rows[stores[i].row];
+            update.insert(update.end() - 1, {
+                {OP_LOAD, it->second, 0},
+                {OP_PUSH_NUM, (int)((unsigned)step * (unsigned)factor), 0},
+                {OP_PLUS, 0, 0},
+                {OP_STORE, it->second, 0}
+            });
+        }
+        program.stackSize = std::max(program.stackSize, 2) + 2;
+    }
+    vector<int> hoisting;
+    for (int loop = 0; loop < (int)loops.size(); loop++) {
+        if (preheaders[loop].empty() == false) {
+            hoisting.push_back(loop);
+        }
+    }
+    std::sort(hoisting.begin(), hoisting.end(), [this](int a, int b) {
+        return loops[a].first > loops[b].first;
+    });
+    for (int i = 0; i < (int)hoisting.size(); i++) {
+        insertPreheader(rows, hoisting[i], preheaders[hoisting[i]]);
+    }
+    program.code.clear();
+    program.rowOffset.clear();
+    for (int i = 0; i < (int)rows.size(); i++) {
+        program.rowOffset.push_back((int)program.code.size());
+        program.code.insert(program.code.end(), rows[i].begin(), rows[i].end());
+    }
+    program.rowOffset.push_back((int)program.code.size());
+    program.emit(OP_HALT);
+}
+
+void Ssa::optimize() {
+    if (program.size() == 0 || isSupported() == false) {
+        return;
+    }
+    findDominators();
+    findLoops();
+    nestLoops();
+    placePhis();
+    rename();
+    markStored();
+    storeRows.assign(program.symbols.size(), {});
+    for (int i = 0; i < (int)stores.size(); i++) {
+        storeRows[stores[i].slot].push_back(stores[i].row);
+    }
+    for (int slot = 0; slot < (int)storeRows.size(); slot++) {
+        std::sort(storeRows[slot].begin(), storeRows[slot].end());
+    }
+    rewrite();
+}
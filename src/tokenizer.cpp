@@ -0,0 +1,193 @@
+#include <array>
+#include "lexemes.h"
+#include "tokenizer.h"
+
+using std::array;
+
+enum CHAR_CLASS {
+    CLASS_OTHER,
+    CLASS_SPACE,
+    CLASS_DIGIT,
+    CLASS_LETTER,
+    CLASS_OPERATOR
+};
+
+struct OperatorState {
+    int single;
+    char follow[2];
+    int pair[2];
+};
+
+static constexpr bool isKeyword(int type) {
+    return type >= IF && type <= GOTO;
+}
+
+static constexpr bool isSymbol(int type) {
+    return isKeyword(type) == false && type != DEREF && type != CALL;
+}
+
+static constexpr array<char, 256> makeCharClasses() {
+    array<char, 256> classes{};
+    for (int c = 'a'; c <= 'z'; c++) {
+        classes[c] = CLASS_LETTER;
+        classes[c - 'a' + 'A'] = CLASS_LETTER;
+    }
+    for (int c = '0'; c <= '9'; c++) {
+        classes[c] = CLASS_DIGIT;
+    }
+    classes['_'] = CLASS_LETTER;
+    classes[' '] = CLASS_SPACE;
+    classes['\t'] = CLASS_SPACE;
+    for (int i = 0; i <= MOD; i++) {
+        if (isSymbol(i)) {
+            classes[(unsigned char)OPERATOR_STRING[i][0]] = CLASS_OPERATOR;
+        }
+    }
+    return classes;
+}
+
+/* Operators are at most two characters long, so the longest-match DFA is
+ * one state per first character with up to two outgoing edges. */
+static constexpr array<OperatorState, 128> makeOperatorStates() {
+    array<OperatorState, 128> states{};
+    for (int c = 0; c < 128; c++) {
+        states[c] = {UNDEFINED, {0, 0}, {UNDEFINED, UNDEFINED}};
+    }
+    for (int i = 0; i <= MOD; i++) {
+        if (isSymbol(i) == false) {
+            continue;
+        }
+        OperatorState & state = states[(unsigned char)OPERATOR_STRING[i][0]];
+        if (OPERATOR_STRING[i][1] == 0) {
+            state.single = i;
+        } else {
+            int edge = state.follow[0] == 0 ? 0 : 1;
+            state.follow[edge] = OPERATOR_STRING[i][1];
+            state.pair[edge] = i;
+        }
+    }
+    return states;
+}
+
+static constexpr int getKeywordHash(char first, int length) {
+    return (3 * first + length) & 7;
+}
+
+static constexpr int getLength(const char *str) {
+    int length = 0;
+    while (str[length] != 0) {
+        length++;
+    }
+    return length;
+}
+
+static constexpr array<int, 8> makeKeywords() {
+    array<int, 8> keywords{};
+    for (int i = 0; i < 8; i++) {
+        keywords[i] = UNDEFINED;
+    }
+    for (int i = IF; i <= GOTO; i++) {
+        keywords[getKeywordHash(OPERATOR_STRING[i][0],
+                                getLength(OPERATOR_STRING[i]))] = i;
+    }
+    return keywords;
+}
+
+static constexpr bool isPerfectHash(const array<int, 8> & keywords) {
+    int count = 0;
+    for (int i = 0; i < 8; i++) {
+        count += keywords[i] != UNDEFINED;
+    }
+    return count == GOTO - IF + 1;
+}
+
+static constexpr array<char, 256> CHAR_CLASSES = makeCharClasses();
+static constexpr array<OperatorState, 128> OPERATOR_STATES = makeOperatorStates();
+static constexpr array<int, 8> KEYWORDS = makeKeywords();
+static constexpr int GOTO_LENGTH = getLength(OPERATOR_STRING[GOTO]);
+
+static_assert(isPerfectHash(KEYWORDS), "keyword hash has collisions");
+
+static int getKeyword(string_view word) {
+    int type = KEYWORDS[getKeywordHash(word[0], (int)word.size())];
+    if (type != UNDEFINED && word == OPERATOR_STRING[type]) {
+        return type;
+    }
+    return UNDEFINED;
+}
+
+static int getClass(char c) {
+    return CHAR_CLASSES[(unsigned char)c];
+}
+
+void tokenize(string_view line, vector<Token> & tokens) {
+    int n = (int)line.size();
+    int i = 0;
+    tokens.clear();
+    while (i < n) {
+        int start = i;
+        switch (getClass(line[i])) {
+            case CLASS_SPACE:
+                i++;
+                break;
+            case CLASS_DIGIT: {
+                unsigned value = 0;
+                while (i < n && getClass(line[i]) == CLASS_DIGIT) {
+                    value = value * 10 + (line[i] - '0');
+                    i++;
+                }
+                tokens.push_back({TOKEN_NUMBER, (int)value, start, i - start});
+                break;
+            }
+            case CLASS_LETTER: {
+                while (i < n && (getClass(line[i]) == CLASS_LETTER ||
+                                 getClass(line[i]) == CLASS_DIGIT)) {
+                    i++;
+                }
+                string_view word = line.substr(start, i - start);
+                int keyword = getKeyword(word);
+                /* goto is only a keyword at the start of a line, and there
+                 * it is split off a name that follows without a space:
+                 * gotoend is goto end. Anywhere else it is a plain name. */
+                if (tokens.empty() && word.size() > GOTO_LENGTH &&
+                    word.compare(0, GOTO_LENGTH, OPERATOR_STRING[GOTO]) == 0 &&
+                    getClass(word[GOTO_LENGTH]) == CLASS_LETTER) {
+                    tokens.push_back({TOKEN_OPERATOR, GOTO, start, GOTO_LENGTH});
+                    tokens.push_back({TOKEN_IDENTIFIER, 0, start + GOTO_LENGTH,
+                                      i - start - GOTO_LENGTH});
+                    break;
+                }
+                if (keyword == GOTO && tokens.empty() == false) {
+                    keyword = UNDEFINED;
+                }
+                if (keyword != UNDEFINED) {
+                    tokens.push_back({TOKEN_OPERATOR, keyword, start, i - start});
+                } else {
+                    tokens.push_back({TOKEN_IDENTIFIER, 0, start, i - start});
+                }
+                break;
+            }
+            case CLASS_OPERATOR: {
+                const OperatorState & state = OPERATOR_STATES[(unsigned char)line[i]];
+                int type = state.single;
+                i++;
+                for (int edge = 0; edge < 2 && i < n; edge++) {
+                    if (state.follow[edge] != 0 && line[i] == state.follow[edge]) {
+                        type = state.pair[edge];
+                        i++;
+                        break;
+                    }
+                }
+                if (type == UNDEFINED) {
+                    tokens.push_back({TOKEN_ERROR, 0, start, i - start});
+                    return;
+                }
+                tokens.push_back({TOKEN_OPERATOR, type, start, i - start});
+                break;
+            }
+            default:
+                tokens.push_back({TOKEN_ERROR, 0, start, 1});
+                return;
+        }
+    }
+}
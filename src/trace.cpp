@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <unistd.h>
+#include "lexemes.h"
+#include "program.h"
+#include "trace.h"
+
+using std::endl;
+
+static const char MAGIC[8] = {'P', 'O', 'L', 'I', 'Z', 'T', 'R', 0};
+
+static const int FATAL_SIGNALS[] = {
+    SIGSEGV, SIGFPE, SIGBUS, SIGILL, SIGABRT, SIGINT, SIGTERM
+};
+
+static thread_local Trace *active = nullptr;
+
+/* Each interpreter thread writes only to its own ring, so recording needs
+ * no locks and no atomics: the counter is bumped after the event is
+ * written, and the signal fence keeps the compiler from reordering the
+ * two for a handler that interrupts this thread. The size is rounded up
+ * to a power of two so that the slot is the counter under a mask. */
+Trace::Trace(const Program & program, const string & path,
+             int size /*= DEFAULT_SIZE*/) : program(program), path(path) {
+    unsigned capacity = 1;
+    while (capacity < (unsigned)std::max(size, 1) && capacity < MAX_SIZE) {
+        capacity <<= 1;
+    }
+    events.resize(capacity);
+    mask = capacity - 1;
+    count = 0;
+}
+
+Trace::~Trace() {
+    if (active == this) {
+        active = nullptr;
+    }
+}
+
+/* Makes this the ring that a signal on the calling thread dumps. */
+void Trace::activate() {
+    active = this;
+}
+
+static bool writeAll(int fd, const void *data, size_t size) {
+    const char *bytes = (const char *)data;
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+/* The file is the header, the source line and first instruction of every
+ * row, the code and then the events still in the ring, oldest first, so
+ * it can be read without the program. Only open, write and close are
+ * called, so this is safe inside a signal handler. */
+bool Trace::dump() const {
+    unsigned long long recorded = count;
+    unsigned stored = recorded < events.size() ? (unsigned)recorded :
+                      (unsigned)events.size();
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.opcodes = OP_HALT + 1;
+    header.rows = (unsigned)program.size();
+    header.instructions = (unsigned)program.code.size();
+    header.events = stored;
+    header.recorded = recorded;
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    unsigned first = (unsigned)((recorded - stored) & mask);
+    unsigned tail = std::min(stored, (unsigned)events.size() - first);
+    bool written = writeAll(fd, &header, sizeof(header)) &&
+                   writeAll(fd, program.lines.data(), header.rows * sizeof(int)) &&
+                   writeAll(fd, program.rowOffset.data(),
+                            (header.rows + 1) * sizeof(int)) &&
+                   writeAll(fd, program.code.data(),
+                            header.instructions * sizeof(Instruction)) &&
+                   writeAll(fd, events.data() + first, tail * sizeof(TraceEvent)) &&
+                   writeAll(fd, events.data(), (stored - tail) * sizeof(TraceEvent));
+    return close(fd) == 0 && written;
+}
+
+/* A fatal signal dumps the ring of the thread it arrived on and then
+ * kills the process as it would have without the handler. SIGUSR1 only
+ * dumps, so a running script can be inspected. */
+void Trace::handleSignal(int signal) {
+    if (active != nullptr) {
+        active->dump();
+    }
+    if (signal != SIGUSR1) {
+        raise(signal);
+    }
+}
+
+void Trace::installHandlers() {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handleSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, nullptr);
+    action.sa_flags = SA_RESETHAND;
+    for (int signal : FATAL_SIGNALS) {
+        sigaction(signal, &action, nullptr);
+    }
+}
+
+enum {
+    READS_LEFT = 1,
+    READS_RIGHT = 2
+};
+
+/* Which of the two recorded stack values an instruction reads. A built-in
+ * reads more, but only its last two arguments are in the event. */
+static int getReads(const Instruction & instruction) {
+    switch (instruction.opcode) {
+        case OP_LOAD_ELEM_UNDER:
+            return READS_LEFT;
+        case OP_LOAD_ELEM:
+        case OP_MULT_POW2:
+        case OP_DIV_POW2:
+        case OP_MOD_POW2:
+        case OP_STORE:
+        case OP_PRINT:
+        case OP_JUMP_FALSE:
+        case OP_BRANCH_EQ:
+        case OP_BRANCH_NEQ:
+        case OP_BRANCH_LEQ:
+        case OP_BRANCH_LT:
+        case OP_BRANCH_GEQ:
+        case OP_BRANCH_GT:
+            return READS_RIGHT;
+        case OP_STORE_ELEM:
+            return READS_LEFT | READS_RIGHT;
+        case OP_CALL:
+            return instruction.argument > 1 ? READS_LEFT | READS_RIGHT :
+                   instruction.argument == 1 ? READS_RIGHT : 0;
+        default:
+            if (instruction.opcode >= OP_OR && instruction.opcode <= OP_MOD) {
+                return READS_LEFT | READS_RIGHT;
+            }
+            return 0;
+    }
+}
+
+/* The constant an instruction carries besides its slot or jump target. */
+static bool getImmediate(const Instruction & instruction, int & value) {
+    switch (instruction.opcode) {
+        case OP_PUSH_NUM:
+        case OP_MULT_POW2:
+        case OP_DIV_POW2:
+        case OP_MOD_POW2:
+        case OP_BRANCH_EQ:
+        case OP_BRANCH_NEQ:
+        case OP_BRANCH_LEQ:
+        case OP_BRANCH_LT:
+        case OP_BRANCH_GEQ:
+        case OP_BRANCH_GT:
+            value = instruction.operand;
+            return true;
+        case OP_INC:
+        case OP_UPDATE_MULT:
+        case OP_LOAD_MOD:
+            value = instruction.argument;
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* The row a terminator passes control to, given the value it tests. */
+static int getTarget(const Instruction & instruction, int row, int right) {
+    switch (instruction.opcode) {
+        case OP_END:
+            return row + 1;
+        case OP_JUMP:
+            return instruction.operand;
+        case OP_JUMP_FALSE:
+            return right == 0 ? instruction.operand : row + 1;
+        case OP_BRANCH_EQ:
+            return right == instruction.operand ? row + 1 : instruction.argument;
+        case OP_BRANCH_NEQ:
+            return right != instruction.operand ? row + 1 : instruction.argument;
+        case OP_BRANCH_LEQ:
+            return right <= instruction.operand ? row + 1 : instruction.argument;
+        case OP_BRANCH_LT:
+            return right < instruction.operand ? row + 1 : instruction.argument;
+        case OP_BRANCH_GEQ:
+            return right >= instruction.operand ? row + 1 : instruction.argument;
+        case OP_BRANCH_GT:
+            return right > instruction.operand ? row + 1 : instruction.argument;
+        default:
+            return UNDEFINED;
+    }
+}
+
+static bool isLayout(const vector<int> & rowOffset, const vector<Instruction> & code) {
+    int rows = (int)rowOffset.size() - 1;
+    if (code.empty() || rowOffset[0] != 0 ||
+        rowOffset[rows] != (int)code.size() - 1) {
+        return false;
+    }
+    for (int row = 0; row < rows; row++) {
+        if (rowOffset[row] >= rowOffset[row + 1]) {
+            return false;
+        }
+    }
+    for (int pc = 0; pc < (int)code.size(); pc++) {
+        if ((unsigned)code[pc].opcode > OP_HALT) {
+            return false;
+        }
+    }
+    return code.back().opcode == OP_HALT;
+}
+
+bool Trace::decode(const string & path, const vector<string_view> & source,
+                   ostream & out, ostream & err) {
+    std::ifstream in(path, std::ios::binary);
+    Header header;
+    if (in.is_open() == false) {
+        err << "Error: cannot read " << path << endl;
+        return false;
+    }
+    if (in.read((char *)&header, sizeof(header)).good() == false ||
+        memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header.version != VERSION || header.opcodes != OP_HALT + 1 ||
+        header.rows >= header.instructions) {
+        err << "Error: " << path << " is not a trace of this interpreter" << endl;
+        return false;
+    }
+    vector<int> lines(header.rows);
+    vector<int> rowOffset(header.rows + 1);
+    vector<Instruction> code(header.instructions);
+    vector<TraceEvent> events(header.events);
+    in.read((char *)lines.data(), lines.size() * sizeof(int));
+    in.read((char *)rowOffset.data(), rowOffset.size() * sizeof(int));
+    in.read((char *)code.data(), code.size() * sizeof(Instruction));
+    in.read((char *)events.data(), events.size() * sizeof(TraceEvent));
+    if (in.good() == false || in.peek() != EOF) {
+        err << "Error: " << path << " is truncated" << endl;
+        return false;
+    }
+    if (isLayout(rowOffset, code) == false) {
+        err << "Error: " << path << " is corrupt" << endl;
+        return false;
+    }
+    unsigned long long index = header.recorded - header.events;
+    if (index > 0) {
+        out << "... " << index << " earlier events dropped" << '\n';
+    }
+    int rows = (int)header.rows;
+    for (int i = 0; i < (int)events.size(); i++, index++) {
+        if (events[i].pc >= header.instructions) {
+            err << "Error: event " << index << " is corrupt" << endl;
+            return false;
+        }
+        const Instruction & instruction = code[events[i].pc];
+        int row = (int)(std::upper_bound(rowOffset.begin(), rowOffset.end(),
+                                         (int)events[i].pc) - rowOffset.begin()) - 1;
+        int target = getTarget(instruction, row, events[i].right);
+        if (target != UNDEFINED && (target < 0 || target > rows)) {
+            err << "Error: event " << index << " is corrupt" << endl;
+            return false;
+        }
+        out << '#' << index << '\t';
+        if (row == rows) {
+            out << "exit" << '\t' << OPCODE_STRING[instruction.opcode] << '\n';
+            continue;
+        }
+        out << "line " << lines[row] + 1 << '\t' << OPCODE_STRING[instruction.opcode] << '\t';
+        int reads = getReads(instruction);
+        int immediate;
+        const char *separator = "";
+        if (reads & READS_LEFT) {
+            out << events[i].left;
+            separator = " ";
+        }
+        if (reads & READS_RIGHT) {
+            out << separator << events[i].right;
+            separator = " ";
+        }
+        if (getImmediate(instruction, immediate)) {
+            out << separator << immediate;
+        }
+        if (target == rows) {
+            out << "\t-> exit";
+        } else if (target != UNDEFINED) {
+            out << "\t-> line " << lines[target] + 1;
+        } else if (instruction.opcode == OP_GOTO) {
+            out << "\t-> undefined label";
+        }
+        int line = lines[row];
+        if (line >= 0 && line < (int)source.size()) {
+            string_view text = source[line];
+            size_t start = text.find_first_not_of(" \t");
+            out << '\t' << (start == string_view::npos ? "" : text.substr(start));
+        }
+        out << '\n';
+    }
+    return true;
+}
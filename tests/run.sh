@@ -0,0 +1,190 @@
+#!/bin/sh
+# Runs every sample and test script in each execution mode and compares
+# what it prints with tests/expected, then checks the features that need
+# more than one run or their own options. Usage: tests/run.sh BIN
+bin=${1:-bin}
+interpreter=$bin/interpreter
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+failures=0
+
+check() {
+    if ! cmp -s "$2" "$3"; then
+        echo "FAIL: $1"
+        diff "$2" "$3" | head -20
+        failures=$((failures + 1))
+    fi
+}
+
+# Runs a script with --dump=final in every execution mode; each must print
+# tests/expected/NAME.final.
+check_final() {
+    name=$(basename "$1" .txt)
+    for options in -O0 "" --no-jit --regvm; do
+        $interpreter --dump=final $options "$1" > "$work/out" 2>&1
+        check "$name --dump=final $options" "tests/expected/$name.final" "$work/out"
+    done
+}
+
+# The same with --dump=all, which keeps every store observable.
+check_all() {
+    name=$(basename "$1" .txt)
+    for options in -O0 "" --regvm; do
+        $interpreter --dump=all $options "$1" > "$work/out" 2>&1
+        check "$name --dump=all $options" "tests/expected/$name.all" "$work/out"
+    done
+}
+
+# --dump=changed and --dump=N, where the register VM has to stop in the
+# middle of the program and resume where the interpreter would.
+check_steps() {
+    name=$(basename "$1" .txt)
+    for mode in changed 7; do
+        for options in -O0 "" --regvm "-O0 --regvm"; do
+            $interpreter --dump=$mode $options "$1" > "$work/out" 2>&1
+            check "$name --dump=$mode $options" "tests/expected/$name.$mode" "$work/out"
+        done
+    done
+}
+
+for script in samples/*.txt; do
+    check_final "$script"
+    check_all "$script"
+    check_steps "$script"
+done
+
+# Folded constants, shifts for powers of two (negative operands round
+# towards zero), dead stores and a line only a skipped goto reaches.
+check_final tests/fold.txt
+check_all tests/fold.txt
+
+# Arithmetic that wraps around, and every kind of superinstruction;
+# --stats counts how many were emitted and run.
+check_final tests/super.txt
+check_all tests/super.txt
+$interpreter --stats --dump=none tests/super.txt 2> "$work/out" > /dev/null
+check "super --stats" tests/expected/super.stats "$work/out"
+
+# Every operator the JIT translates, on values only known at run time,
+# with arrays, a built-in call and a goto loop.
+check_final tests/jit.txt
+check_all tests/jit.txt
+check_steps tests/jit.txt
+
+# Keywords as name prefixes, goto glued to its label and goto used as a
+# name, operators without spaces, a tab and a number that wraps around.
+check_final tests/tokens.txt
+check_all tests/tokens.txt
+
+# Negative and far-off indices switch arrays to paged storage, which
+# reads, writes and built-ins must treat like dense storage.
+check_final tests/arrays.txt
+check_all tests/arrays.txt
+$interpreter --memory --dump=none tests/arrays.txt 2> "$work/out" > /dev/null
+check "arrays --memory" tests/expected/arrays.memory "$work/out"
+
+# Loops with invariant expressions, common subexpressions, induction
+# variables and assignments inside expressions, as the SSA pass sees them
+# for --dump=final; the graph shows what it hoisted.
+check_final tests/ssa.txt
+$interpreter --cfg --dump=final tests/ssa.txt > "$work/out" 2>&1
+check "ssa --cfg --dump=final" tests/expected/ssa.cfg "$work/out"
+
+# Every bulk built-in over ranges shorter than, equal to and longer than
+# one AVX2 block, each repeated with a plain loop; bad counts the
+# elements where the two disagree.
+check_final tests/builtins.txt
+
+# A cache with a flipped byte, a truncated one and one that is not a cache
+# at all must each be recompiled from source and then replaced.
+cache=$work/while.cache
+run_cached() {
+    $interpreter --dump=final --cache="$cache" samples/while.txt > "$work/out" 2>&1
+    check "$1" tests/expected/while.final "$work/out"
+}
+run_cached "cache written"
+size=$(wc -c < "$cache")
+printf '\377' | dd of="$cache" bs=1 seek=$((size - 1)) conv=notrunc 2> /dev/null
+run_cached "cache with a flipped byte"
+run_cached "cache rewritten after a flipped byte"
+head -c 20 "$cache" > "$work/truncated" && mv "$work/truncated" "$cache"
+run_cached "truncated cache"
+printf 'not a cache\n' > "$cache"
+run_cached "malformed cache"
+run_cached "cache rewritten after a malformed one"
+
+# A script with the size and modification time the cache was written for
+# is not read again, so an edit that keeps both still runs the cached
+# program. Once the time changes the text is hashed, and the edit is
+# compiled and cached.
+script=$work/arithm.txt
+cache=$work/arithm.cache
+cp samples/arithm.txt "$script"
+touch -d '2001-01-01 00:00:00' "$script"
+$interpreter --dump=final --cache="$cache" "$script" > "$work/out" 2>&1
+check "cache round trip" tests/expected/arithm.final "$work/out"
+sed 's/4/6/' samples/arithm.txt > "$script"
+touch -d '2001-01-01 00:00:00' "$script"
+$interpreter --dump=final --cache="$cache" "$script" > "$work/out" 2>&1
+check "cache of a file with the same size and time" tests/expected/arithm.final "$work/out"
+touch "$script"
+$interpreter --dump=final "$script" > "$work/expected" 2>&1
+$interpreter --dump=final --cache="$cache" "$script" > "$work/out" 2>&1
+check "cache of an edited file" "$work/expected" "$work/out"
+$interpreter --dump=final --cache="$cache" "$script" > "$work/out" 2>&1
+check "cache rewritten after an edit" "$work/expected" "$work/out"
+$interpreter --dump=all --cache="$cache" "$script" > "$work/out" 2>&1
+$interpreter --dump=all "$script" > "$work/expected" 2>&1
+check "cache written for other optimizer settings" "$work/expected" "$work/out"
+
+# Blocks that arrive over several lines, a block dropped with the line
+# that has a syntax error, a goto back to an earlier statement and one to
+# a label that was never entered.
+$interpreter --repl --dump=changed < tests/repl.txt > "$work/out" 2>&1
+check "repl" tests/expected/repl.out "$work/out"
+
+# Control flow graphs: of each sample as it runs by default, of labels.txt
+# with the line its goto skips still in place, and of fold.txt with the
+# constants and dead stores the SSA pass removes for --dump=final.
+for script in samples/*.txt; do
+    name=$(basename "$script" .txt)
+    $interpreter --cfg "$script" > "$work/out" 2>&1
+    check "$name --cfg" "tests/expected/$name.cfg" "$work/out"
+done
+$interpreter --cfg -O0 samples/labels.txt > "$work/out" 2>&1
+check "labels --cfg -O0" tests/expected/labels.O0.cfg "$work/out"
+$interpreter --cfg --dump=final tests/fold.txt > "$work/out" 2>&1
+check "fold --cfg --dump=final" tests/expected/fold.cfg "$work/out"
+
+$interpreter tests/undefined.txt > "$work/out" 2>&1
+check "undefined label" tests/expected/undefined.out "$work/out"
+if $interpreter --cfg tests/undefined.txt > /dev/null 2>&1; then
+    echo "FAIL: undefined label with --cfg exits with status 0"
+    failures=$((failures + 1))
+fi
+
+# Division by zero stops only the script that does it, with an error.
+check_final tests/division.txt
+$bin/batch tests/division.txt samples/arithm.txt > "$work/out" 2> /dev/null
+status=$?
+check "batch with a division by zero" tests/expected/batch.out "$work/out"
+if [ $status -ne 1 ]; then
+    echo "FAIL: batch with a division by zero exits with status $status"
+    failures=$((failures + 1))
+fi
+
+# A trace written when the program ends, and one written by the division
+# by zero that stops it, read back with tracedump; the second ring holds
+# only the last 16 instructions.
+$interpreter --dump=none --trace="$work/trace" --trace-exit samples/arithm.txt > /dev/null 2>&1
+$bin/tracedump "$work/trace" samples/arithm.txt > "$work/out" 2>&1
+check "trace at exit" tests/expected/arithm.trace "$work/out"
+$interpreter --dump=none --trace="$work/trace" --trace-size=16 tests/division.txt > /dev/null 2>&1
+$bin/tracedump "$work/trace" tests/division.txt > "$work/out" 2>&1
+check "trace on an error" tests/expected/division.trace "$work/out"
+
+if [ $failures -ne 0 ]; then
+    echo "$failures failed"
+    exit 1
+fi
+echo "all tests passed"
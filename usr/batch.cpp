@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include "lexemes.h"
+#include "tokenizer.h"
+#include "interpreter.h"
+#include "program.h"
+#include "optimizer.h"
+#include "jit.h"
+#include "source.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::ostringstream;
+using std::mutex;
+using std::lock_guard;
+using std::unique_lock;
+using std::condition_variable;
+using std::deque;
+using std::thread;
+
+namespace fs = std::filesystem;
+
+struct Script {
+    string path;
+    ostringstream out;
+    ostringstream err;
+    bool failed = false;
+    bool done = false;
+};
+
+class WorkQueue {
+    mutex lock;
+    deque<int> tasks;
+public:
+    void push(int task);
+    bool pop(int & task);
+    bool steal(int & task);
+};
+
+void WorkQueue::push(int task) {
+    lock_guard<mutex> guard(lock);
+    tasks.push_back(task);
+}
+
+bool WorkQueue::pop(int & task) {
+    lock_guard<mutex> guard(lock);
+    if (tasks.empty()) {
+        return false;
+    }
+    task = tasks.front();
+    tasks.pop_front();
+    return true;
+}
+
+bool WorkQueue::steal(int & task) {
+    lock_guard<mutex> guard(lock);
+    if (tasks.empty()) {
+        return false;
+    }
+    task = tasks.back();
+    tasks.pop_back();
+    return true;
+}
+
+class Batch {
+    vector<Script> scripts;
+    vector<WorkQueue> queues;
+    mutex doneLock;
+    condition_variable doneSignal;
+    DUMP mode;
+    int steps;
+    bool optimize;
+    bool native;
+
+    void runScript(Script & script);
+    bool steal(int worker, int & task);
+    void work(int worker);
+public:
+    Batch(const vector<string> & paths, DUMP mode, int steps, bool optimize,
+          bool native);
+    bool run(int jobs);
+};
+
+Batch::Batch(const vector<string> & paths, DUMP mode, int steps,
+             bool optimize, bool native) :
+    scripts(paths.size()) {
+    for (int i = 0; i < (int)paths.size(); i++) {
+        scripts[i].path = paths[i];
+    }
+    Batch::mode = mode;
+    Batch::steps = steps;
+    Batch::optimize = optimize;
+    Batch::native = native;
+}
+
+void Batch::runScript(Script & script) {
+    Parser parser;
+    Program program;
+    Source source;
+    if (source.open(script.path) == false) {
+        script.err << "Error: cannot open " << script.path << endl;
+        script.failed = true;
+        return;
+    }
+    if (parser.buildPoliz(source.getLines(), script.err) == false) {
+        script.failed = true;
+        return;
+    }
+    bool compiled = program.compile(parser.poliz, parser.symbols,
+                                    parser.labels, script.err);
+    parser.freePoliz();
+    if (compiled == false) {
+        script.failed = true;
+        return;
+    }
+    if (optimize) {
+        Optimizer(program).optimize(mode != DUMP_NONE && mode != DUMP_FINAL);
+    }
+    Interpreter interpreter(program, script.out, script.err);
+    Jit jit(program);
+    if (native && (mode == DUMP_NONE || mode == DUMP_FINAL) && jit.compile()) {
+        jit.run(interpreter);
+    }
+    interpreter.execute(mode, steps);
+    script.failed = interpreter.hasFailed();
+}
+
+bool Batch::steal(int worker, int & task) {
+    for (int i = 1; i < (int)queues.size(); i++) {
+        if (queues[(worker + i) % queues.size()].steal(task)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Batch::work(int worker) {
+    int task;
+    while (queues[worker].pop(task) || steal(worker, task)) {
+        runScript(scripts[task]);
+        {
+            lock_guard<mutex> guard(doneLock);
+            scripts[task].done = true;
+        }
+        doneSignal.notify_all();
+    }
+}
+
+bool Batch::run(int jobs) {
+    bool failed = false;
+    int n = (int)scripts.size();
+    vector<thread> workers;
+    jobs = std::max(1, std::min(jobs, n));
+    queues = vector<WorkQueue>(jobs);
+    for (int i = 0; i < n; i++) {
+        queues[(long long)i * jobs / n].push(i);
+    }
+    for (int i = 0; i < jobs; i++) {
+        workers.push_back(thread(&Batch::work, this, i));
+    }
+    for (int i = 0; i < n; i++) {
+        {
+            unique_lock<mutex> guard(doneLock);
+            doneSignal.wait(guard, [&] { return scripts[i].done; });
+        }
+        cout << "==> " << scripts[i].path << " <==" << '\n';
+        cout << scripts[i].out.str();
+        cout.flush();
+        cerr << scripts[i].err.str();
+        scripts[i].out.str(string());
+        scripts[i].err.str(string());
+        failed = failed || scripts[i].failed;
+    }
+    for (int i = 0; i < jobs; i++) {
+        workers[i].join();
+    }
+    return failed == false;
+}
+
+bool getScripts(string path, vector<string> & paths) {
+    std::error_code error;
+    if (fs::is_directory(path, error)) {
+        vector<string> entries;
+        for (const fs::directory_entry & entry : fs::directory_iterator(path, error)) {
+            if (entry.is_regular_file(error)) {
+                entries.push_back(entry.path().string());
+            }
+        }
+        std::sort(entries.begin(), entries.end());
+        paths.insert(paths.end(), entries.begin(), entries.end());
+        return error.value() == 0;
+    }
+    paths.push_back(path);
+    return true;
+}
+
+enum {
+    MAX_JOBS = 1024
+};
+
+int main(int argc, char *argv[]) {
+    DUMP mode = DUMP_FINAL;
+    int steps = 1;
+    bool optimize = true;
+    bool native = true;
+    int jobs = (int)thread::hardware_concurrency();
+    vector<string> paths;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.compare(0, 7, "--jobs=") == 0) {
+            if (arg.size() == 7 || arg.size() > 7 + 4 ||
+                arg.find_first_not_of("0123456789", 7) != string::npos ||
+                std::stoi(arg.substr(7)) > MAX_JOBS) {
+                paths.clear();
+                break;
+            }
+            jobs = std::stoi(arg.substr(7));
+        } else if (arg == "-O0") {
+            optimize = false;
+        } else if (arg == "--no-jit") {
+            native = false;
+        } else if (arg.compare(0, 2, "--") == 0) {
+            if (getDumpMode(arg, mode, steps) == false) {
+                paths.clear();
+                break;
+            }
+        } else if (getScripts(arg, paths) == false) {
+            cerr << "Error: cannot read directory " << arg << endl;
+            return 1;
+        }
+    }
+    if (paths.empty()) {
+        cerr << "Usage: " << argv[0] <<
+            " [-O0] [--no-jit] [--dump=all|none|final|changed|N] [--jobs=N] FILE|DIR..." << endl;
+        return 1;
+    }
+    Batch batch(paths, mode, steps, optimize, native);
+    return batch.run(jobs > 0 ? jobs : 1) ? 0 : 1;
+}
@@ -0,0 +1,317 @@
+#include <chrono>
+#include <iomanip>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "lexemes.h"
+#include "tokenizer.h"
+#include "interpreter.h"
+#include "program.h"
+#include "optimizer.h"
+#include "jit.h"
+#include "regvm.h"
+#include "trace.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::to_string;
+
+typedef std::chrono::steady_clock Clock;
+
+struct Result {
+    bool failed;
+    long long lines;
+    long long bytes;
+    double parse;
+    double compile;
+    double run;
+    long long statements;
+};
+
+struct Workload {
+    const char *name;
+    vector<string> (*generate)(int scale);
+};
+
+static vector<string> getArithmetic(int scale) {
+    vector<string> code = {
+        "n := " + to_string(2000 * scale),
+        "i := 0",
+        "while i < n then"
+    };
+    for (int k = 0; k < 40; k++) {
+        code.push_back("v" + to_string(k % 8) + " := (v" + to_string((k + 1) % 8) +
+                       " * " + to_string(k + 3) + " + v" + to_string((k + 2) % 8) +
+                       ") % " + to_string(1000 + k) + " - " + to_string(k));
+    }
+    code.push_back("i := i + 1");
+    code.push_back("endwhile");
+    return code;
+}
+
+static vector<string> getNestedLoops(int scale) {
+    return {
+        "n := " + to_string(60 * scale),
+        "s := 0",
+        "i := 0",
+        "while i < n then",
+        "j := 0",
+        "while j < n then",
+        "k := 0",
+        "while k < 20 then",
+        "s := (s + i * j - k) % 1000000",
+        "k := k + 1",
+        "endwhile",
+        "j := j + 1",
+        "endwhile",
+        "i := i + 1",
+        "endwhile"
+    };
+}
+
+static vector<string> getBranches(int scale) {
+    return {
+        "n := " + to_string(50000 * scale),
+        "i := 0",
+        "while i < n then",
+        "if i % 3 == 0 then",
+        "a := a + 1",
+        "else",
+        "if i % 5 == 0 then",
+        "b := b + 1",
+        "else",
+        "c := c + 1",
+        "endif",
+        "endif",
+        "if a > b then",
+        "d := d + a - b",
+        "else",
+        "d := d - 1",
+        "endif",
+        "i := i + 1",
+        "endwhile"
+    };
+}
+
+static vector<string> getArrayScan(int scale) {
+    return {
+        "n := " + to_string(10000 * scale),
+        "i := 0",
+        "while i < n then",
+        "a[i] := i * 7 % 1000",
+        "i := i + 1",
+        "endwhile",
+        "r := 0",
+        "while r < 10 then",
+        "i := 0",
+        "t := 0",
+        "while i < n then",
+        "t := t + a[i]",
+        "i := i + 1",
+        "endwhile",
+        "t := sum(a, 0, n) + max(a, 0, n)",
+        "adds(a, 1, 0, n)",
+        "r := r + 1",
+        "endwhile"
+    };
+}
+
+static vector<string> getGotos(int scale) {
+    return {
+        "n := " + to_string(50000 * scale),
+        "i := 0",
+        "t := 0",
+        "top:",
+        "t := t + i % 7",
+        "i := i + 1",
+        "if i % 2 == 0 then",
+        "goto even",
+        "endif",
+        "t := t - 1",
+        "even:",
+        "if i < n then",
+        "goto top",
+        "endif"
+    };
+}
+
+static vector<string> getLargeSource(int scale) {
+    vector<string> code;
+    for (int k = 0; k < 200000 * scale; k++) {
+        code.push_back("x" + to_string(k % 100) + " := x" + to_string((k + 1) % 100) +
+                       " + " + to_string(k) + " * (y" + to_string(k % 37) + " - " +
+                       to_string(k % 11) + ")");
+    }
+    return code;
+}
+
+static const Workload WORKLOADS[] = {
+    {"arithmetic", getArithmetic},
+    {"nested_loops", getNestedLoops},
+    {"branches", getBranches},
+    {"array_scan", getArrayScan},
+    {"goto", getGotos},
+    {"large_source", getLargeSource}
+};
+
+static double getMilliseconds(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+/* Parsing covers the tokenizer and parser, compiling covers bytecode,
+ * the optimizer and the JIT. Each phase keeps its best time over the
+ * repetitions. Statements are the lines executed by the unoptimized
+ * program, so the rate stays comparable when the optimizer changes. */
+static Result measure(const Workload & workload, int scale, int repeat,
+                      bool native, bool registers, bool tracing) {
+    vector<string> text = workload.generate(scale);
+    vector<string_view> lines(text.begin(), text.end());
+    Result result = {false, (long long)lines.size(), 0, 0, 0, 0, 0};
+    for (int i = 0; i < (int)text.size(); i++) {
+        result.bytes += text[i].size() + 1;
+    }
+    std::ostream discard(nullptr);
+    for (int i = 0; i < repeat; i++) {
+        Parser parser;
+        Program program;
+        Clock::time_point start = Clock::now();
+        if (parser.buildPoliz(lines, cerr) == false) {
+            result.failed = true;
+            return result;
+        }
+        Clock::time_point parsed = Clock::now();
+        bool compiled = program.compile(parser.poliz, parser.symbols,
+                                        parser.labels, cerr);
+        parser.freePoliz();
+        if (compiled == false) {
+            result.failed = true;
+            return result;
+        }
+        Optimizer(program).optimize(false);
+        Jit jit(program);
+        RegisterVm vm(program);
+        bool translated = tracing == false &&
+                          (registers ? vm.compile() : native && jit.compile());
+        Trace trace(program, "", tracing ? Trace::DEFAULT_SIZE : 1);
+        Clock::time_point ready = Clock::now();
+        Interpreter interpreter(program, discard, discard);
+        if (tracing) {
+            interpreter.setTrace(&trace);
+        }
+        if (translated && registers) {
+            vm.execute(interpreter, DUMP_NONE, 0);
+        } else if (translated) {
+            jit.run(interpreter);
+        }
+        interpreter.execute(DUMP_NONE, 0);
+        Clock::time_point finished = Clock::now();
+        double parse = getMilliseconds(start, parsed);
+        double compile = getMilliseconds(parsed, ready);
+        double run = getMilliseconds(ready, finished);
+        if (i == 0 || parse < result.parse) {
+            result.parse = parse;
+        }
+        if (i == 0 || compile < result.compile) {
+            result.compile = compile;
+        }
+        if (i == 0 || run < result.run) {
+            result.run = run;
+        }
+    }
+    Parser parser;
+    Program program;
+    parser.buildPoliz(lines, cerr);
+    program.compile(parser.poliz, parser.symbols, parser.labels, cerr);
+    parser.freePoliz();
+    Interpreter interpreter(program, discard, discard);
+    interpreter.countRows();
+    interpreter.execute(DUMP_NONE, 0);
+    result.statements = interpreter.getExecutedRows();
+    return result;
+}
+
+/* Every workload runs in its own process so that peak RSS is its own. */
+static bool runWorkload(const Workload & workload, int scale, int repeat,
+                        bool native, bool registers, bool tracing) {
+    int channel[2];
+    if (pipe(channel) != 0) {
+        return false;
+    }
+    pid_t child = fork();
+    if (child < 0) {
+        return false;
+    }
+    if (child == 0) {
+        close(channel[0]);
+        Result result = measure(workload, scale, repeat, native, registers,
+                                tracing);
+        bool written = write(channel[1], &result, sizeof(result)) == sizeof(result);
+        _exit(written ? 0 : 1);
+    }
+    close(channel[1]);
+    Result result;
+    bool received = read(channel[0], &result, sizeof(result)) == sizeof(result);
+    close(channel[0]);
+    int status;
+    struct rusage usage;
+    if (wait4(child, &status, 0, &usage) != child || received == false ||
+        result.failed) {
+        cerr << "Error: workload " << workload.name << " failed" << endl;
+        return false;
+    }
+    double rate = result.run > 0 ? result.statements / (result.run / 1000) : 0;
+    cout << workload.name << '\t' << result.lines << '\t' << result.bytes <<
+        '\t' << result.parse << '\t' << result.compile << '\t' << result.run <<
+        '\t' << result.statements << '\t' << (long long)rate << '\t' <<
+        usage.ru_maxrss << endl;
+    return true;
+}
+
+static bool getNumber(const string & arg, const string & prefix, int & value) {
+    if (arg.compare(0, prefix.size(), prefix) != 0 || arg.size() == prefix.size() ||
+        arg.size() > prefix.size() + 6 ||
+        arg.find_first_not_of("0123456789", prefix.size()) != string::npos) {
+        return false;
+    }
+    value = std::stoi(arg.substr(prefix.size()));
+    return value > 0;
+}
+
+int main(int argc, char *argv[]) {
+    int scale = 1;
+    int repeat = 3;
+    bool native = true;
+    bool registers = false;
+    bool tracing = false;
+    string only;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--no-jit") {
+            native = false;
+        } else if (arg == "--regvm") {
+            registers = true;
+        } else if (arg == "--trace") {
+            tracing = true;
+        } else if (arg.compare(0, 7, "--only=") == 0) {
+            only = arg.substr(7);
+        } else if (getNumber(arg, "--scale=", scale) == false &&
+                   getNumber(arg, "--repeat=", repeat) == false) {
+            cerr << "Usage: " << argv[0] <<
+                " [--scale=N] [--repeat=N] [--no-jit] [--regvm] [--trace]"
+                " [--only=WORKLOAD]" << endl;
+            return 1;
+        }
+    }
+    cout << std::fixed << std::setprecision(3);
+    cout << "workload\tlines\tbytes\tparse_ms\tcompile_ms\trun_ms\t"
+            "statements\tstatements_per_s\tpeak_rss_kb" << endl;
+    bool failed = false;
+    for (const Workload & workload : WORKLOADS) {
+        if (only.empty() || only == workload.name) {
+            failed = runWorkload(workload, scale, repeat, native, registers,
+                                 tracing) == false || failed;
+        }
+    }
+    return failed ? 1 : 0;
+}
@@ -1,24 +1,227 @@
+#include <deque>
 #include "lexemes.h"
+#include "tokenizer.h"
 #include "interpreter.h"
+#include "program.h"
+#include "optimizer.h"
+#include "jit.h"
+#include "source.h"
+#include "profiler.h"
+#include "cache.h"
+#include "cfg.h"
+#include "regvm.h"
+#include "trace.h"
 
-using std::cin;
-using std::getline;
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::deque;
 
-int main() {
+/* Every statement, or block once its end arrives, is compiled onto the end
+ * of the program and run straight away, so variables, arrays and labels
+ * carry over and earlier lines are never parsed again. */
+static void runInteractive(DUMP mode, int steps) {
     Parser parser;
-    vector<string> code;
-    string codeline;
-    while (getline(cin, codeline)) {
-        code.push_back(codeline);
+    Program program;
+    Interpreter interpreter(program);
+    deque<string> lines;
+    string line;
+    while (std::getline(std::cin, line)) {
+        lines.push_back(line);
+        if (parser.addLine(lines.back()) == false) {
+            lines.clear();
+        } else if (parser.isComplete()) {
+            if (program.append(parser.poliz, parser.symbols, parser.labels)) {
+                parser.freePoliz();
+                interpreter.execute(mode, steps);
+            } else {
+                parser.discard();
+            }
+            lines.clear();
+        }
+        cout.flush();
+    }
+}
+
+static void printUsage(const char *name) {
+    cerr << "Usage: " << name <<
+        " [-O0] [--no-jit] [--regvm] [--stats] [--memory] [--profile[=FILE]]"
+        " [--cache[=PATH]] [--cfg] [--trace[=FILE]] [--trace-size=N] [--trace-exit]"
+        " [--dump=all|none|final|changed|N]"
+        " [FILE]" << '\n' <<
+        "       " << name << " --repl [--dump=all|none|final|changed|N]" << endl;
+}
+
+int main(int argc, char *argv[]) {
+    Parser parser;
+    Program program;
+    DUMP mode = DUMP_EVERY;
+    int steps = 1;
+    bool optimize = true;
+    bool statistics = false;
+    bool native = true;
+    bool memory = false;
+    string profile;
+    string cachePath;
+    bool caching = false;
+    bool interactive = false;
+    bool graph = false;
+    bool registers = false;
+    string tracePath;
+    int traceSize = Trace::DEFAULT_SIZE;
+    bool traceExit = false;
+    Source source;
+    string path;
+    for (int i = 1; i < argc; i++) {
+        if (string(argv[i]) == "-O0") {
+            optimize = false;
+        } else if (string(argv[i]) == "--stats") {
+            statistics = true;
+        } else if (string(argv[i]) == "--memory") {
+            memory = true;
+        } else if (string(argv[i]) == "--profile") {
+            profile = "profile.json";
+        } else if (string(argv[i]).compare(0, 10, "--profile=") == 0 &&
+                   argv[i][10] != 0) {
+            profile = argv[i] + 10;
+        } else if (string(argv[i]) == "--trace") {
+            tracePath = "trace.bin";
+        } else if (string(argv[i]).compare(0, 8, "--trace=") == 0 &&
+                   argv[i][8] != 0) {
+            tracePath = argv[i] + 8;
+        } else if (string(argv[i]) == "--trace-exit") {
+            traceExit = true;
+        } else if (string(argv[i]).compare(0, 13, "--trace-size=") == 0 &&
+                   string(argv[i]).size() > 13 && string(argv[i]).size() < 23 &&
+                   string(argv[i]).find_first_not_of("0123456789", 13) == string::npos) {
+            if (std::stoll(string(argv[i]).substr(13)) > Trace::MAX_SIZE) {
+                cerr << "Error: --trace-size must be at most " << Trace::MAX_SIZE << endl;
+                return 1;
+            }
+            traceSize = std::stoi(string(argv[i]).substr(13));
+        } else if (string(argv[i]) == "--repl") {
+            interactive = true;
+        } else if (string(argv[i]) == "--regvm") {
+            registers = true;
+        } else if (string(argv[i]) == "--cfg") {
+            graph = true;
+        } else if (string(argv[i]) == "--cache") {
+            caching = true;
+        } else if (string(argv[i]).compare(0, 8, "--cache=") == 0 &&
+                   argv[i][8] != 0) {
+            cachePath = argv[i] + 8;
+        } else if (string(argv[i]) == "--no-jit") {
+            native = false;
+        } else if (argv[i][0] != '-' && path.empty()) {
+            path = argv[i];
+        } else if (getDumpMode(argv[i], mode, steps) == false) {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (traceExit && tracePath.empty()) {
+        tracePath = "trace.bin";
+    }
+    /* The REPL reads only standard input. */
+    if (interactive && path.empty() == false) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (interactive) {
+        runInteractive(mode, steps);
+        return 0;
+    }
+    if (caching && cachePath.empty()) {
+        if (path.empty()) {
+            cerr << "Error: --cache needs a FILE or a PATH" << endl;
+            return 1;
+        }
+        cachePath = path + ".cache";
     }
 
-    if (parser.buildPoliz(code)) {
-        int i = 0;
-        while (i < (int)code.size()) {
-            i = evaluatePoliz(parser.poliz[i], i);
-            printMap();
+    bool observable = mode != DUMP_NONE && mode != DUMP_FINAL;
+    Cache cache(cachePath, optimize == false ? 0 : observable ? 1 : 2);
+    bool compiled = false;
+    /* A cache written for the unchanged script file is used without
+     * reading the script, unless the profiler needs its text. */
+    if (cachePath.empty() == false && path.empty() == false) {
+        cache.setFile(path);
+        compiled = cache.load(program);
+    }
+    if ((compiled == false || profile.empty() == false) &&
+        (path.empty() ? source.readStdin() : source.open(path)) == false) {
+        cerr << "Error: cannot read " << (path.empty() ? "stdin" : path) << endl;
+        return 1;
+    }
+    if (compiled == false && cachePath.empty() == false) {
+        cache.setSource(source.getLines());
+        compiled = cache.load(program);
+        if (compiled && path.empty() == false && cache.save(program) == false) {
+            cerr << "Warning: cannot write " << cachePath << endl;
         }
+    }
+    if (compiled == false && parser.buildPoliz(source.getLines())) {
+        compiled = program.compile(parser.poliz, parser.symbols, parser.labels);
         parser.freePoliz();
+        if (compiled && optimize) {
+            Optimizer(program).optimize(observable);
+        }
+        if (compiled && cachePath.empty() == false && cache.save(program) == false) {
+            cerr << "Warning: cannot write " << cachePath << endl;
+        }
+    }
+    if (compiled == false && graph) {
+        return 1;
+    }
+    if (compiled && graph) {
+        ControlFlowGraph(program).print(cout);
+        return 0;
+    }
+    if (compiled) {
+        Interpreter interpreter(program);
+        Jit jit(program);
+        RegisterVm vm(program);
+        bool tracing = tracePath.empty() == false;
+        Trace trace(program, tracePath, tracing ? traceSize : 1);
+        bool counted = statistics || profile.empty() == false;
+        if (counted) {
+            interpreter.countRows();
+        }
+        if (tracing) {
+            if (registers) {
+                cerr << "Warning: --trace runs the bytecode interpreter, "
+                        "not the register VM" << endl;
+            }
+            trace.activate();
+            Trace::installHandlers();
+            interpreter.setTrace(&trace);
+        }
+        bool interpreted = counted || tracing;
+        if (interpreted == false && registers && vm.compile()) {
+            vm.execute(interpreter, mode, steps);
+        } else {
+            if (interpreted == false && native && (mode == DUMP_NONE || mode == DUMP_FINAL) &&
+                jit.compile()) {
+                jit.run(interpreter);
+            }
+            interpreter.execute(mode, steps);
+        }
+        if (traceExit && trace.dump() == false) {
+            cerr << "Error: cannot write " << tracePath << endl;
+        }
+        if (statistics) {
+            interpreter.printStatistics();
+        }
+        if (memory) {
+            interpreter.printMemory();
+        }
+        if (profile.empty() == false) {
+            Profiler profiler(program, interpreter, source.getLines());
+            profiler.printReport(cerr);
+            if (profiler.write(profile) == false) {
+                cerr << "Error: cannot write " << profile << endl;
+            }
+        }
     }
     return 0;
 }
@@ -0,0 +1,28 @@
+#include "lexemes.h"
+#include "tokenizer.h"
+#include "program.h"
+#include "source.h"
+#include "trace.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+/* Prints a trace written by --trace one event per line, with the text of
+ * each source line when the script that produced it is given. */
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 3) {
+        cerr << "Usage: " << argv[0] << " TRACE [FILE]" << endl;
+        return 1;
+    }
+    Source source;
+    vector<string_view> lines;
+    if (argc == 3) {
+        if (source.open(argv[2]) == false) {
+            cerr << "Error: cannot read " << argv[2] << endl;
+            return 1;
+        }
+        lines = source.getLines();
+    }
+    return Trace::decode(argv[1], lines, cout, cerr) ? 0 : 1;
+}